@@ -0,0 +1,345 @@
+// aggregateanchor.h
+#ifndef ANCHORS_AGGREGATEANCHOR_H
+#define ANCHORS_AGGREGATEANCHOR_H
+
+#include "anchor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * An Anchor whose value aggregates any number of input Anchors of the same
+ * type. The Engine tells it which inputs may have changed, so a stabilization
+ * only visits the inputs that changed instead of all of them.
+ *
+ * @tparam T - type of the Anchor's value.
+ * @tparam InputType - type of the input Anchors.
+ */
+template <typename T, typename InputType>
+class AggregateAnchor : public Anchor<T> {
+   public:
+    /**
+     * Creates an AggregateAnchor.
+     *
+     * @param inputs - input Anchors.
+     * @param initial - value of the Anchor until it is first computed.
+     */
+    AggregateAnchor(
+        std::vector<std::shared_ptr<AnchorWrap<InputType>>> inputs,
+        const T&                                            initial);
+
+   protected:
+    // PROTECTED MANIPULATORS
+    virtual T rebuild() = 0;
+    // Reads every input and returns the aggregated value.
+
+    virtual T apply(const std::vector<std::uint32_t>& changed) = 0;
+    // Reads the inputs at the indices in `changed`, which may not have
+    // changed, and returns the aggregated value.
+
+    // PROTECTED DATA
+    std::vector<std::shared_ptr<AnchorWrap<InputType>>> d_inputs;
+
+   private:
+    // PRIVATE MANIPULATORS
+    void compute(int stabilizationNumber) override;
+    // Applies the changes of the inputs reported since the last computation,
+    // or rebuilds the value from all of them if some may not have been
+    // reported.
+
+    void markDependencyChanged(const AnchorBase* dependency) override;
+    // Adds the inputs that are `dependency` to the pending inputs, or
+    // schedules a rebuild if it is null.
+
+    // PRIVATE ACCESSORS
+    bool isOutdated() const override;
+    // Returns true if the Anchor is not frozen, and has never been computed,
+    // has pending inputs, or has an input that changed since it was last
+    // computed while a rebuild is scheduled.
+
+    std::vector<std::shared_ptr<AnchorBase>> getDependencies() const override;
+    // Returns the input Anchors.
+
+    // PRIVATE DATA
+    std::unordered_multimap<const AnchorBase*, std::uint32_t> d_indices;
+    // Indices of each input Anchor in `d_inputs`.
+
+    std::vector<std::uint32_t> d_pending;
+    // Indices of the inputs reported as changed since the last computation.
+
+    std::vector<char> d_isPending;
+    // Whether each input is in `d_pending`.
+
+    bool d_isRebuildNeeded;
+    // Whether some changes of the inputs may not have been reported, which is
+    // the case when the Anchor isn't necessary, or the Engine unlinks it from
+    // its inputs or loads a snapshot.
+};
+
+/**
+ * An AggregateAnchor that folds its inputs with an invertible operation, such
+ * as a sum. When an input changes, its old value is removed from the result
+ * and its new value added, so the cost of a stabilization is proportional to
+ * the number of inputs that changed. See Anchors::fold()
+ *
+ * @tparam T - type of the Anchor's value.
+ * @tparam InputType - type of the input Anchors.
+ */
+template <typename T, typename InputType>
+class FoldAnchor : public AggregateAnchor<T, InputType> {
+   public:
+    /**
+     * Alias for a function that adds an input value to, or removes it from,
+     * an accumulated value and returns the result.
+     */
+    using Accumulator = std::function<T(const T&, const InputType&)>;
+
+    /**
+     * Creates a FoldAnchor.
+     *
+     * @param inputs - input Anchors.
+     * @param initial - value of the Anchor when there are no inputs.
+     * @param add - function adding an input value to the result.
+     * @param remove - inverse of `add`.
+     */
+    FoldAnchor(std::vector<std::shared_ptr<AnchorWrap<InputType>>> inputs,
+               const T&                                            initial,
+               const Accumulator&                                  add,
+               const Accumulator&                                  remove);
+
+   private:
+    // PRIVATE MANIPULATORS
+    T rebuild() override;
+
+    T apply(const std::vector<std::uint32_t>& changed) override;
+
+    // PRIVATE DATA
+    T d_initial;
+
+    Accumulator d_add;
+
+    Accumulator d_remove;
+
+    std::vector<InputType> d_values;
+    // Value of each input included in the result.
+};
+
+/**
+ * An AggregateAnchor that combines its inputs with an associative and
+ * commutative operation that has no inverse, such as a minimum. The partial
+ * results are kept in a balanced binary tree inside the Anchor, so a changed
+ * input costs O(log N) applications of the operation. See Anchors::reduce()
+ *
+ * @tparam T - type of the Anchor's value and of its inputs.
+ */
+template <typename T>
+class ReduceAnchor : public AggregateAnchor<T, T> {
+   public:
+    /**
+     * Alias for a function that combines two values.
+     */
+    using Operation = std::function<T(const T&, const T&)>;
+
+    /**
+     * Creates a ReduceAnchor.
+     *
+     * @param inputs - input Anchors.
+     * @param operation - associative and commutative function.
+     * @throws std::invalid_argument if `inputs` is empty.
+     */
+    ReduceAnchor(std::vector<std::shared_ptr<AnchorWrap<T>>> inputs,
+                 const Operation&                            operation);
+
+   private:
+    // PRIVATE MANIPULATORS
+    T rebuild() override;
+
+    T apply(const std::vector<std::uint32_t>& changed) override;
+
+    // PRIVATE DATA
+    Operation d_operation;
+
+    std::vector<T> d_tree;
+    // The input values are the leaves, from index N, and each node `i` below N
+    // combines its children `2i` and `2i + 1`, so the result is at index 1.
+};
+
+template <typename T, typename InputType>
+AggregateAnchor<T, InputType>::AggregateAnchor(
+    std::vector<std::shared_ptr<AnchorWrap<InputType>>> inputs,
+    const T&                                            initial)
+    : Anchor<T>(initial),
+      d_inputs(std::move(inputs)),
+      d_indices(),
+      d_pending(),
+      d_isPending(d_inputs.size()),
+      d_isRebuildNeeded(false) {
+    for (std::size_t i = 0; i < d_inputs.size(); i++) {
+        this->d_height = std::max(this->d_height, d_inputs[i]->getHeight() + 1);
+        d_indices.emplace(d_inputs[i].get(), static_cast<std::uint32_t>(i));
+    }
+}
+
+template <typename T, typename InputType>
+void AggregateAnchor<T, InputType>::compute(int stabilizationNumber) {
+    if (this->d_recomputeId == stabilizationNumber) {
+        // Don't compute a node more than once in the same cycle
+        return;
+    }
+
+    const bool isFirstComputation = this->d_hasNeverBeenComputed;
+    this->d_recomputeId           = stabilizationNumber;
+    this->d_hasNeverBeenComputed  = false;
+
+    if (isFirstComputation || d_isRebuildNeeded) {
+        this->updateValue(rebuild(), stabilizationNumber);
+    } else if (!d_pending.empty()) {
+        this->updateValue(apply(d_pending), stabilizationNumber);
+    }
+
+    for (std::uint32_t i : d_pending) {
+        d_isPending[i] = false;
+    }
+    d_pending.clear();
+
+    // Changes of the inputs are only reported while the Anchor is necessary.
+    d_isRebuildNeeded = this->d_necessary <= 0;
+}
+
+template <typename T, typename InputType>
+void AggregateAnchor<T, InputType>::markDependencyChanged(
+    const AnchorBase* dependency) {
+    if (!dependency) {
+        d_isRebuildNeeded = true;
+        return;
+    }
+
+    auto [first, last] = d_indices.equal_range(dependency);
+    for (auto it = first; it != last; it++) {
+        if (!d_isPending[it->second]) {
+            d_isPending[it->second] = true;
+            d_pending.push_back(it->second);
+        }
+    }
+}
+
+template <typename T, typename InputType>
+bool AggregateAnchor<T, InputType>::isOutdated() const {
+    if (this->d_isFrozen) {
+        return false;
+    }
+
+    if (this->d_hasNeverBeenComputed || !d_pending.empty()) {
+        return true;
+    }
+
+    return d_isRebuildNeeded &&
+           std::any_of(d_inputs.begin(), d_inputs.end(), [this](auto& input) {
+               return this->d_recomputeId < input->getChangeId();
+           });
+}
+
+template <typename T, typename InputType>
+std::vector<std::shared_ptr<AnchorBase>>
+AggregateAnchor<T, InputType>::getDependencies() const {
+    return {d_inputs.begin(), d_inputs.end()};
+}
+
+template <typename T, typename InputType>
+FoldAnchor<T, InputType>::FoldAnchor(
+    std::vector<std::shared_ptr<AnchorWrap<InputType>>> inputs,
+    const T&                                            initial,
+    const Accumulator&                                  add,
+    const Accumulator&                                  remove)
+    : AggregateAnchor<T, InputType>(std::move(inputs), initial),
+      d_initial(initial),
+      d_add(add),
+      d_remove(remove),
+      d_values() {}
+
+template <typename T, typename InputType>
+T FoldAnchor<T, InputType>::rebuild() {
+    d_values.clear();
+    d_values.reserve(this->d_inputs.size());
+
+    T result = d_initial;
+    for (const auto& input : this->d_inputs) {
+        d_values.push_back(input->get());
+        result = d_add(result, d_values.back());
+    }
+
+    return result;
+}
+
+template <typename T, typename InputType>
+T FoldAnchor<T, InputType>::apply(const std::vector<std::uint32_t>& changed) {
+    T result = this->d_value;
+    for (std::uint32_t i : changed) {
+        InputType value = this->d_inputs[i]->get();
+        if (value != d_values[i]) {
+            result      = d_add(d_remove(result, d_values[i]), value);
+            d_values[i] = std::move(value);
+        }
+    }
+
+    return result;
+}
+
+template <typename T>
+ReduceAnchor<T>::ReduceAnchor(
+    std::vector<std::shared_ptr<AnchorWrap<T>>> inputs,
+    const Operation&                            operation)
+    : AggregateAnchor<T, T>(std::move(inputs), T()),
+      d_operation(operation),
+      d_tree() {
+    if (this->d_inputs.empty()) {
+        throw std::invalid_argument("anchors::ReduceAnchor: no inputs");
+    }
+}
+
+template <typename T>
+T ReduceAnchor<T>::rebuild() {
+    const std::size_t n = this->d_inputs.size();
+
+    d_tree.resize(2 * n);
+    for (std::size_t i = 0; i < n; i++) {
+        d_tree[n + i] = this->d_inputs[i]->get();
+    }
+
+    for (std::size_t i = n - 1; i >= 1; i--) {
+        d_tree[i] = d_operation(d_tree[2 * i], d_tree[2 * i + 1]);
+    }
+
+    return d_tree[1];
+}
+
+template <typename T>
+T ReduceAnchor<T>::apply(const std::vector<std::uint32_t>& changed) {
+    const std::size_t n = this->d_inputs.size();
+
+    for (std::uint32_t i : changed) {
+        T value = this->d_inputs[i]->get();
+        if (value == d_tree[n + i]) {
+            continue;
+        }
+
+        d_tree[n + i] = std::move(value);
+        for (std::size_t node = (n + i) / 2; node >= 1; node /= 2) {
+            d_tree[node] = d_operation(d_tree[2 * node], d_tree[2 * node + 1]);
+        }
+    }
+
+    return d_tree[1];
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_AGGREGATEANCHOR_H
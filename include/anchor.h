@@ -3,28 +3,40 @@
 #define ANCHORS_ANCHOR_H
 
 #include "anchorbase.h"
+#include "memocache.h"
+#include "scratch.h"
+#include "serializer.h"
 
 #include <algorithm>
-#include <boost/uuid/uuid_generators.hpp>
-#include <boost/uuid/uuid_io.hpp>
+#include <any>
+#include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
+#include <string>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 template <>
 struct std::hash<anchors::AnchorBase> {
     std::size_t operator()(const anchors::AnchorBase& a) const noexcept {
-        return hash_value(a.getId());
+        return std::hash<anchors::AnchorBase::AnchorId>()(a.getId());
     }
 };
 
-// Used by the priority queue in the Engine class to store Anchors in increasing
-// order.
+// Used by the priority queue in the Engine class to store Anchors in the order
+// they are recomputed: in decreasing order of priority, then in increasing
+// order of height. An Anchor's dependencies always have a priority at least as
+// high as its own, so this order is also a topological order.
 template <>
 struct std::greater<std::shared_ptr<anchors::AnchorBase>> {
     bool operator()(const std::shared_ptr<anchors::AnchorBase>& a1,
                     const std::shared_ptr<anchors::AnchorBase>& a2) const {
+        if (a1->getPriority() != a2->getPriority()) {
+            return a1->getPriority() < a2->getPriority();
+        }
+
         return a1->getHeight() > a2->getHeight();
     }
 };
@@ -43,10 +55,32 @@ class AnchorWrap : public AnchorBase {
     virtual ~AnchorWrap(){};
     virtual T get() const = 0;
 
+    /**
+     * Returns the cache statistics of an Anchor created with memoization
+     * enabled, or empty statistics otherwise.
+     */
+    virtual MemoStats getMemoStats() const = 0;
+
    protected:
-    virtual void set(const T& value) = 0;
+    virtual void set(T value) = 0;
+
+    virtual const T& getValueRef() const = 0;
+    // Returns a reference to the current value of the Anchor, which is valid
+    // until the value next changes.
+
+    virtual T& getMutableValueRef() = 0;
+    // Returns a reference through which the value of the Anchor can be
+    // modified in place.
+
+    // PROTECTED DATA
+    bool d_isTimeAnchor{};
+    // Whether the Anchor is a TimeAnchor, whose value only the clock of the
+    // Engine changes. Lets `Engine::set()` reject it without a cast.
 
     friend class Engine;
+
+    template <typename, typename, typename>
+    friend class Anchor;
 };
 
 /**
@@ -102,8 +136,12 @@ class Anchor : public AnchorWrap<T> {
 
     ~Anchor() override = default;
 
+    MemoStats getMemoStats() const override;
+
     friend class Engine;
 
+    friend class Anchors;
+
     friend std::ostream& operator<<(std::ostream& out, const Anchor& anchor) {
         out << "[ value=" << anchor.get() << ", height=" << anchor.getHeight(),
             ", firstDependency=" << anchor.d_firstDependency
@@ -113,11 +151,38 @@ class Anchor : public AnchorWrap<T> {
         return out;
     }
 
+   protected:
+    // PROTECTED MANIPULATORS
+    void updateValue(T newValue, int stabilizationNumber);
+    // Stores `newValue` as the value of the Anchor and sets its changeId to
+    // the given stabilizationNumber if it differs from the current value.
+
    private:
+    // PRIVATE TYPES
+    struct StateCopy {
+        T d_value;
+
+        int d_recomputeId;
+
+        int d_changeId;
+
+        bool d_hasNeverBeenComputed;
+    };
+
     // PRIVATE MANIPULATORS
     T get() const override;
     // Returns the current value of an Anchor.
 
+    void startCompute(int stabilizationNumber) override;
+    // Starts computing the value of an Anchor without waiting for the result.
+    // This is a no-op for Anchors with synchronous updaters, which do all
+    // their work in `compute()`.
+
+    void cancelCompute() override;
+    // Discards the work started by `startCompute()`, so the next computation
+    // starts again from the current inputs. This is a no-op for Anchors with
+    // synchronous updaters.
+
     void compute(int stabilizationNumber) override;
     // Computes the value of an Anchor based on its inputs and updater function.
     // When this function is called by the Engine, it is guaranteed that the
@@ -126,24 +191,43 @@ class Anchor : public AnchorWrap<T> {
     // stabilizationNumber, and will update the changeId only if the Anchor
     // value changes after recomputing.
 
-    void markNecessary() override;
+    void markNecessary(int priority) override;
     // Increments the `necessary count` of an Anchor. An Anchor is necessary if
     // it is a dependency of an observed Anchor, either directly or indirectly.
+    // `priority` is the priority of that observed Anchor.
 
     bool isNecessary() const override;
     // Returns true if at least one observed Anchor depends on it, either
     // directly or indirectly.
 
     bool isStale() const override;
-    // Returns true if the Anchor is necessary and has never been computed or
-    // its recomputeId is less than the changeId of one of its children.
+    // Returns true if the Anchor is necessary and outdated.
+
+    bool isOutdated() const override;
+    // Returns true if the Anchor is not frozen, and has never been computed or
+    // its recomputeId is less than the changeId of one of its children,
+    // whether or not it is necessary.
+
+    bool isFrozen() const override;
+    // Returns true if the value of the Anchor can never change again.
+
+    void markFrozen() override;
+    // Marks the value of the Anchor as final.
 
-    void decrementNecessaryCount() override;
-    // Decrements the `necessary count` of an Anchor after a dependant is marked
-    // as unobserved.
+    void decrementNecessaryCount(int priority) override;
+    // Decrements the `necessary count` of an Anchor after a dependant with the
+    // given priority is marked as unobserved.
+
+    int getPriority() const override;
+    // Returns the highest priority of the observed Anchors that depend on this
+    // Anchor, or 0 if there are none.
+
+    void updatePriority();
+    // Recomputes the priority of the Anchor from the priorities of its
+    // observers.
 
     AnchorBase::AnchorId getId() const override;
-    // Returns the generated UUID of the Anchor.
+    // Returns the ID of the Anchor, which is unique within the process.
 
     int getHeight() const override;
     // Returns the height of an Anchor. An Anchor's height must always be
@@ -158,9 +242,15 @@ class Anchor : public AnchorWrap<T> {
     void setChangeId(int changeId) override;
     // Set the ID at which the value of an Anchor changed.
 
-    void set(const T& value) override;
+    void set(T value) override;
     // Set the value of the Anchor.
 
+    const T& getValueRef() const override;
+    // Returns a reference to the current value of the Anchor.
+
+    T& getMutableValueRef() override;
+    // Returns a modifiable reference to the current value of the Anchor.
+
     void addDependant(const std::shared_ptr<AnchorBase>& dependant) override;
     // Adds the given Anchor as a dependant of this Anchor. When this Anchor's
     // value changes, we want to know update its dependants.
@@ -168,17 +258,46 @@ class Anchor : public AnchorWrap<T> {
     void removeDependant(const std::shared_ptr<AnchorBase>& dependant) override;
     // Removes the given Anchor from the dependants of this Anchor.
 
-    std::unordered_set<std::shared_ptr<AnchorBase>> getDependants()
+    const std::unordered_set<std::shared_ptr<AnchorBase>>& getDependants()
         const override;
     // Returns the dependants of this Anchor.
 
+    const std::unordered_set<std::shared_ptr<AnchorBase>>&
+    getChangedDependants() const override;
+    // Returns the dependants affected by the last change of the value of this
+    // Anchor, which are all of its dependants.
+
     std::vector<std::shared_ptr<AnchorBase>> getDependencies() const override;
     // Returns the dependencies of this Anchor.
 
-    // PRIVATE DATA
-    boost::uuids::random_generator d_idGenerator;
+    void markDependencyChanged(const AnchorBase* dependency) override;
+    // Called by the Engine when the value of `dependency`, or of any
+    // dependency if it is null, may have changed. This is a no-op, since the
+    // Anchor reads all of its inputs when it is computed.
+
+    void saveValue(std::vector<char>& buffer) const override;
+    // Appends the value of this Anchor to `buffer` if `Serializer<T>`
+    // supports it.
+
+    void saveState(std::vector<char>& buffer) const override;
+    // Appends the recomputeId, changeId and, if `Serializer<T>` supports it,
+    // the value of this Anchor to `buffer`.
 
-    boost::uuids::uuid d_id;
+    void loadState(const char*& cursor, const char* end) override;
+    // Restores the state written by `saveState()`, starting at `cursor`, and
+    // advances `cursor` past it. An Anchor saved without a value is marked as
+    // never computed, so that it is recomputed when next needed.
+
+    std::any copyState() const override;
+    // Returns a copy of the value, recomputeId and changeId of this Anchor.
+
+    void restoreState(std::any& state) override;
+    // Restores the state returned by `copyState()`, moving the value out of
+    // `state`.
+
+   protected:
+    // PROTECTED DATA
+    AnchorBase::AnchorId d_id;
 
     T d_value{};
 
@@ -190,6 +309,14 @@ class Anchor : public AnchorWrap<T> {
     // Indicates how many Anchors this node is a dependency of either directly
     // or indirectly.
 
+    int d_priority{};
+    // Highest priority of the observed Anchors that depend on this Anchor.
+
+    std::map<int, int> d_priorityCounts;
+    // Number of observed Anchors with each priority other than the default
+    // priority of 0 that depend on this Anchor. It stays empty, and doesn't
+    // allocate, unless priorities are used.
+
     int d_numDependencies{};
     // Number of dependencies this Anchor has.
 
@@ -201,6 +328,10 @@ class Anchor : public AnchorWrap<T> {
 
     bool d_hasNeverBeenComputed;
 
+    bool d_isFrozen{};
+    // Whether the value of the Anchor can never change again. A frozen Anchor
+    // is never stale and is not linked to its dependencies or dependants.
+
     const std::shared_ptr<AnchorWrap<InputType1>> d_firstDependency;
     const std::shared_ptr<AnchorWrap<InputType2>> d_secondDependency;
 
@@ -210,11 +341,15 @@ class Anchor : public AnchorWrap<T> {
     SingleInputUpdater d_singleInputUpdater;
 
     DualInputUpdater d_dualInputUpdater;
+
+    std::shared_ptr<MemoCacheBase> d_memoCache;
+    // Cache used by the updater function if memoization is enabled. It is
+    // only stored here to report its statistics.
 };
 
 template <typename T, typename InputType1, typename InputType2>
 Anchor<T, InputType1, InputType2>::Anchor(const T& value)
-    : d_id(d_idGenerator()),
+    : d_id(nextAnchorId()),
       d_value(value),
       d_hasNeverBeenComputed(true),
       d_dependants() {}
@@ -223,7 +358,7 @@ template <typename T, typename InputType1, typename InputType2>
 Anchor<T, InputType1, InputType2>::Anchor(
     const std::shared_ptr<AnchorWrap<InputType1>>& input,
     const SingleInputUpdater&                      updater)
-    : d_id(d_idGenerator()),
+    : d_id(nextAnchorId()),
       d_height(input->getHeight() + 1),
       d_numDependencies(1),
       d_hasNeverBeenComputed(true),
@@ -236,7 +371,7 @@ Anchor<T, InputType1, InputType2>::Anchor(
     const std::shared_ptr<AnchorWrap<InputType1>>& firstInput,
     const std::shared_ptr<AnchorWrap<InputType2>>& secondInput,
     const DualInputUpdater&                        updater)
-    : d_id(d_idGenerator()),
+    : d_id(nextAnchorId()),
       d_height(std::max(firstInput->getHeight(), secondInput->getHeight()) + 1),
       d_numDependencies(2),
       d_hasNeverBeenComputed(true),
@@ -257,7 +392,6 @@ void Anchor<T, InputType1, InputType2>::compute(int stabilizationNumber) {
         return;
     }
 
-    T newValue;
     d_recomputeId = stabilizationNumber;
 
     d_hasNeverBeenComputed = false;
@@ -266,25 +400,51 @@ void Anchor<T, InputType1, InputType2>::compute(int stabilizationNumber) {
         return;
     }
 
+    // The inputs are copied into the scratch resource if they support it, and
+    // the result is passed straight to `updateValue()`, so that updaters that
+    // use the scratch resource don't touch the global allocator.
     if (d_numDependencies == 1) {
-        InputType1 inputVal = d_firstDependency->get();
-        newValue            = d_singleInputUpdater(inputVal);
+        InputType1 inputVal = copyToScratch(d_firstDependency->getValueRef());
+        updateValue(d_singleInputUpdater(inputVal), stabilizationNumber);
     } else {
-        InputType1 inputVal  = d_firstDependency->get();
-        InputType2 inputVal2 = d_secondDependency->get();
+        InputType1 inputVal = copyToScratch(d_firstDependency->getValueRef());
+        InputType2 inputVal2 =
+            copyToScratch(d_secondDependency->getValueRef());
 
-        newValue = d_dualInputUpdater(inputVal, inputVal2);
+        updateValue(d_dualInputUpdater(inputVal, inputVal2),
+                    stabilizationNumber);
     }
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::startCompute(int) {}
 
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::cancelCompute() {}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::updateValue(T   newValue,
+                                                    int stabilizationNumber) {
     if (newValue != d_value) {
         d_changeId = stabilizationNumber;
-        d_value    = newValue;
+        d_value    = std::move(newValue);
     }
 }
 
 template <typename T, typename InputType1, typename InputType2>
-void Anchor<T, InputType1, InputType2>::markNecessary() {
+MemoStats Anchor<T, InputType1, InputType2>::getMemoStats() const {
+    return d_memoCache ? d_memoCache->getStats() : MemoStats();
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::markNecessary(int priority) {
     d_necessary++;
+
+    if (priority != 0) {
+        d_priorityCounts[priority]++;
+    }
+
+    updatePriority();
 }
 
 template <typename T, typename InputType1, typename InputType2>
@@ -294,6 +454,15 @@ bool Anchor<T, InputType1, InputType2>::isNecessary() const {
 
 template <typename T, typename InputType1, typename InputType2>
 bool Anchor<T, InputType1, InputType2>::isStale() const {
+    return isNecessary() && isOutdated();
+}
+
+template <typename T, typename InputType1, typename InputType2>
+bool Anchor<T, InputType1, InputType2>::isOutdated() const {
+    if (d_isFrozen) {
+        return false;
+    }
+
     bool recomputeIdLessThanChildChangeId = false;
 
     if (d_numDependencies >= 1) {
@@ -306,17 +475,57 @@ bool Anchor<T, InputType1, InputType2>::isStale() const {
         }
     }
 
-    return isNecessary() &
-           (d_hasNeverBeenComputed || recomputeIdLessThanChildChangeId);
+    return d_hasNeverBeenComputed || recomputeIdLessThanChildChangeId;
+}
+
+template <typename T, typename InputType1, typename InputType2>
+bool Anchor<T, InputType1, InputType2>::isFrozen() const {
+    return d_isFrozen;
 }
 
 template <typename T, typename InputType1, typename InputType2>
-void Anchor<T, InputType1, InputType2>::decrementNecessaryCount() {
+void Anchor<T, InputType1, InputType2>::markFrozen() {
+    d_isFrozen = true;
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::decrementNecessaryCount(int priority) {
     if (d_necessary <= 0) {
         return;
     }
 
     d_necessary--;
+
+    auto it = d_priorityCounts.find(priority);
+    if (it != d_priorityCounts.end() && --it->second == 0) {
+        d_priorityCounts.erase(it);
+    }
+
+    updatePriority();
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::updatePriority() {
+    if (d_priorityCounts.empty()) {
+        d_priority = 0;
+        return;
+    }
+
+    int numPrioritized = 0;
+    for (const auto& [priority, count] : d_priorityCounts) {
+        numPrioritized += count;
+    }
+
+    d_priority = d_priorityCounts.rbegin()->first;
+    if (numPrioritized < d_necessary) {
+        // Some observers have the default priority.
+        d_priority = std::max(d_priority, 0);
+    }
+}
+
+template <typename T, typename InputType1, typename InputType2>
+int Anchor<T, InputType1, InputType2>::getPriority() const {
+    return d_priority;
 }
 
 template <typename T, typename InputType1, typename InputType2>
@@ -345,8 +554,18 @@ void Anchor<T, InputType1, InputType2>::setChangeId(int changeId) {
 }
 
 template <typename T, typename InputType1, typename InputType2>
-void Anchor<T, InputType1, InputType2>::set(const T& value) {
-    d_value = value;
+void Anchor<T, InputType1, InputType2>::set(T value) {
+    d_value = std::move(value);
+}
+
+template <typename T, typename InputType1, typename InputType2>
+const T& Anchor<T, InputType1, InputType2>::getValueRef() const {
+    return d_value;
+}
+
+template <typename T, typename InputType1, typename InputType2>
+T& Anchor<T, InputType1, InputType2>::getMutableValueRef() {
+    return d_value;
 }
 
 template <typename T, typename InputType1, typename InputType2>
@@ -362,15 +581,15 @@ void Anchor<T, InputType1, InputType2>::removeDependant(
 }
 
 template <typename T, typename InputType1, typename InputType2>
-std::unordered_set<std::shared_ptr<AnchorBase>>
+const std::unordered_set<std::shared_ptr<AnchorBase>>&
 Anchor<T, InputType1, InputType2>::getDependants() const {
-    std::unordered_set<std::shared_ptr<AnchorBase>> result;
-
-    for (auto& parent : d_dependants) {
-        result.insert(parent);
-    }
+    return d_dependants;
+}
 
-    return result;
+template <typename T, typename InputType1, typename InputType2>
+const std::unordered_set<std::shared_ptr<AnchorBase>>&
+Anchor<T, InputType1, InputType2>::getChangedDependants() const {
+    return d_dependants;
 }
 
 template <typename T, typename InputType1, typename InputType2>
@@ -389,6 +608,80 @@ Anchor<T, InputType1, InputType2>::getDependencies() const {
     return result;
 }
 
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::markDependencyChanged(
+    const AnchorBase*) {}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::saveState(
+    std::vector<char>& buffer) const {
+    Serializer<int>::write(buffer, d_recomputeId);
+    Serializer<int>::write(buffer, d_changeId);
+    Serializer<bool>::write(buffer, d_hasNeverBeenComputed);
+    Serializer<bool>::write(buffer, Serializer<T>::isSupported);
+    saveValue(buffer);
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::saveValue(
+    std::vector<char>& buffer) const {
+    if constexpr (Serializer<T>::isSupported) {
+        Serializer<T>::write(buffer, d_value);
+    }
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::loadState(const char*& cursor,
+                                                  const char* end) {
+    d_recomputeId          = Serializer<int>::read(cursor, end);
+    d_changeId             = Serializer<int>::read(cursor, end);
+    d_hasNeverBeenComputed = Serializer<bool>::read(cursor, end);
+
+    bool hasValue = Serializer<bool>::read(cursor, end);
+    if constexpr (Serializer<T>::isSupported) {
+        if (hasValue) {
+            d_value = Serializer<T>::read(cursor, end);
+            return;
+        }
+    }
+
+    d_hasNeverBeenComputed = true;
+}
+
+template <typename T, typename InputType1, typename InputType2>
+std::any Anchor<T, InputType1, InputType2>::copyState() const {
+    return StateCopy{
+        d_value, d_recomputeId, d_changeId, d_hasNeverBeenComputed};
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void Anchor<T, InputType1, InputType2>::restoreState(std::any& state) {
+    StateCopy& copy = std::any_cast<StateCopy&>(state);
+
+    d_value                = std::move(copy.d_value);
+    d_recomputeId          = copy.d_recomputeId;
+    d_changeId             = copy.d_changeId;
+    d_hasNeverBeenComputed = copy.d_hasNeverBeenComputed;
+}
+
+/**
+ * Expands `MACRO(EXTERN, T)` for each value type whose templates are compiled
+ * into the library, so translation units that use them don't instantiate them
+ * again. `EXTERN` is `extern` in the headers and empty in the library.
+ */
+#define ANCHORS_FOR_EACH_COMMON_TYPE(MACRO, EXTERN) \
+    MACRO(EXTERN, bool)                             \
+    MACRO(EXTERN, int)                              \
+    MACRO(EXTERN, std::int64_t)                     \
+    MACRO(EXTERN, double)                           \
+    MACRO(EXTERN, std::string)
+
+#define ANCHORS_INSTANTIATE_ANCHOR(EXTERN, T) \
+    EXTERN template class AnchorWrap<T>;      \
+    EXTERN template class Anchor<T>;
+
+ANCHORS_FOR_EACH_COMMON_TYPE(ANCHORS_INSTANTIATE_ANCHOR, extern)
+
 }  // namespace anchors
 
 #endif
@@ -1,9 +1,8 @@
 #ifndef ANCHORS_ANCHORBASE_H
 #define ANCHORS_ANCHORBASE_H
 
-#pragma comment(lib, "bcrypt.lib")  // For Windows machines
-
-#include <boost/uuid/uuid.hpp>
+#include <any>
+#include <cstdint>
 #include <memory>
 #include <unordered_set>
 #include <vector>
@@ -18,12 +17,16 @@ namespace anchors {
  ***/
 class AnchorBase {
    public:
-    using AnchorId = boost::uuids::uuid;
+    using AnchorId = std::uint64_t;
 
     virtual ~AnchorBase(){};
 
+    virtual void startCompute(int stabilizationNumber) = 0;
+
     virtual void compute(int stabilizationNumber) = 0;
 
+    virtual void cancelCompute() = 0;
+
     virtual AnchorId getId() const = 0;
 
     virtual int getHeight() const = 0;
@@ -34,24 +37,55 @@ class AnchorBase {
 
     virtual void setChangeId(int changeId) = 0;
 
-    virtual void markNecessary() = 0;
+    virtual int getPriority() const = 0;
 
-    virtual void decrementNecessaryCount() = 0;
+    virtual void markNecessary(int priority) = 0;
+
+    virtual void decrementNecessaryCount(int priority) = 0;
 
     virtual bool isNecessary() const = 0;
 
     virtual bool isStale() const = 0;
 
-    virtual std::unordered_set<std::shared_ptr<AnchorBase>> getDependants()
-        const = 0;
+    virtual bool isOutdated() const = 0;
+
+    virtual bool isFrozen() const = 0;
+
+    virtual void markFrozen() = 0;
+
+    virtual const std::unordered_set<std::shared_ptr<AnchorBase>>&
+    getDependants() const = 0;
+
+    virtual const std::unordered_set<std::shared_ptr<AnchorBase>>&
+    getChangedDependants() const = 0;
 
     virtual std::vector<std::shared_ptr<AnchorBase>> getDependencies()
         const = 0;
 
+    virtual void markDependencyChanged(const AnchorBase* dependency) = 0;
+
     virtual void addDependant(const std::shared_ptr<AnchorBase>& parent) = 0;
 
     virtual void removeDependant(const std::shared_ptr<AnchorBase>& parent) = 0;
+
+    virtual void saveValue(std::vector<char>& buffer) const = 0;
+
+    virtual void saveState(std::vector<char>& buffer) const = 0;
+
+    virtual void loadState(const char*& cursor, const char* end) = 0;
+
+    virtual std::any copyState() const = 0;
+
+    virtual void restoreState(std::any& state) = 0;
 };
+
+/**
+ * Returns an Anchor ID that is unique within the process. Each thread takes
+ * IDs from its own range of consecutive IDs and only touches shared state when
+ * the range runs out, so Anchors can be created from many threads at once.
+ */
+AnchorBase::AnchorId nextAnchorId();
+
 }  // namespace anchors
 
 #endif  // ANCHORS_ANCHORBASE_H
@@ -2,7 +2,11 @@
 #ifndef ANCHORS_ANCHORS_H
 #define ANCHORS_ANCHORS_H
 
+#include "aggregateanchor.h"
 #include "anchor.h"
+#include "asyncanchor.h"
+#include "selectanchor.h"
+#include "timeanchor.h"
 
 /**
  * Main library namespace
@@ -50,6 +54,30 @@ class Anchors {
         const AnchorPtr<InputType1>                              &anchor,
         const typename Anchor<T, InputType1>::SingleInputUpdater &updater);
 
+    /**
+     * Creates an Anchor from an input Anchor whose updater results are
+     * memoized. Before calling `updater`, the Anchor looks up the input value
+     * in a bounded cache of previous results, and reuses the result on a hit.
+     * Use this when the input often returns to a value seen before and
+     * `updater` is expensive.
+     *
+     * @tparam T - type of the output Anchor. `T` should overload the
+     * equality and output operators if not already defined.
+     * @tparam InputType1 - optional type of the input Anchor. Required only if
+     * this type is different from the output Anchor Type T. It must be
+     * hashable with `boost::hash`.
+     * @param anchor - input Anchor
+     * @param updater - function that maps the input Anchor to the output. It
+     * must depend only on its input.
+     * @param options - limits of the cache.
+     * @return a shared pointer to the created Anchor
+     */
+    template <typename T, typename InputType1 = T>
+    static AnchorPtr<T> map(
+        const AnchorPtr<InputType1>                              &anchor,
+        const typename Anchor<T, InputType1>::SingleInputUpdater &updater,
+        const MemoOptions                                        &options);
+
     /**
      * Creates an Anchor from two input Anchors.
      *
@@ -71,6 +99,31 @@ class Anchors {
         const typename Anchor<T, InputType1, InputType2>::DualInputUpdater
             &updater);
 
+    /**
+     * Creates an Anchor from two input Anchors whose updater results are
+     * memoized on the pair of input values. See map() with `MemoOptions`.
+     *
+     * @tparam T - type of the output Anchor. `T` should overload the
+     * equality and output operators if not already defined.
+     * @tparam InputType1 - optional type of the first input Anchor. Required
+     * only if this type is different from the output Anchor Type T.
+     * @tparam InputType2 - optional type of the second input Anchor. Required
+     * only if this type is different from the output Anchor Type T.
+     * @param anchor1 - first input Anchor.
+     * @param anchor2 - second input Anchor.
+     * @param updater - function that maps the input Anchors to the output. It
+     * must depend only on its inputs.
+     * @param options - limits of the cache.
+     * @return a shared pointer to the created Anchor.
+     */
+    template <typename T, typename InputType1 = T, typename InputType2 = T>
+    static AnchorPtr<T> map2(
+        const AnchorPtr<InputType1> &anchor1,
+        const AnchorPtr<InputType2> &anchor2,
+        const typename Anchor<T, InputType1, InputType2>::DualInputUpdater
+                          &updater,
+        const MemoOptions &options);
+
     /**
      *  Creates an Anchor from three input Anchors
      * @tparam T - type of the output Anchor. `T` should overload the
@@ -130,6 +183,161 @@ class Anchors {
         const std::function<
             T(InputType1 &, InputType2 &, InputType3 &, InputType4 &)>
             &updater);
+
+    /**
+     * Creates an Anchor from an input Anchor using an asynchronous updater.
+     * The updater should start its work and return immediately, e.g. by
+     * calling `std::async`. During stabilization, all stale asynchronous
+     * Anchors at the same height run concurrently.
+     *
+     * @tparam T - type of the output Anchor. `T` should overload the
+     * equality and output operators if not already defined.
+     * @tparam InputType1 - optional type of the input Anchor. Required only if
+     * this type is different from the output Anchor Type T.
+     * @param anchor - input Anchor
+     * @param updater - function that returns a future holding the output.
+     * @return a shared pointer to the created Anchor
+     */
+    template <typename T, typename InputType1 = T>
+    static AnchorPtr<T> mapAsync(
+        const AnchorPtr<InputType1> &anchor,
+        const typename AsyncAnchor<T, InputType1>::AsyncSingleInputUpdater
+            &updater);
+
+    /**
+     * Creates an Anchor from two input Anchors using an asynchronous updater.
+     * See mapAsync().
+     *
+     * @tparam T - type of the output Anchor. `T` should overload the
+     * equality and output operators if not already defined.
+     * @tparam InputType1 - optional type of the first input Anchor. Required
+     * only if this type is different from the output Anchor Type T.
+     * @tparam InputType2 - optional type of the second input Anchor. Required
+     * only if this type is different from the output Anchor Type T.
+     * @param anchor1 - first input Anchor.
+     * @param anchor2 - second input Anchor.
+     * @param updater - function that returns a future holding the output.
+     * @return a shared pointer to the created Anchor.
+     */
+    template <typename T, typename InputType1 = T, typename InputType2 = T>
+    static AnchorPtr<T> mapAsync2(
+        const AnchorPtr<InputType1> &anchor1,
+        const AnchorPtr<InputType2> &anchor2,
+        const typename AsyncAnchor<T, InputType1, InputType2>::
+            AsyncDualInputUpdater &updater);
+
+    /**
+     * Creates an Anchor holding the sum of any number of input Anchors. When
+     * inputs change, the old values of those inputs are subtracted from the
+     * sum and the new values added, so a stabilization costs O(changed inputs)
+     * rather than O(inputs). Floating-point sums may therefore drift slightly
+     * from a sum computed from scratch.
+     *
+     * @tparam T - type of the Anchors. `T()` must be the identity of `+`.
+     * @param inputs - input Anchors.
+     * @return a shared pointer to the created Anchor.
+     */
+    template <typename T>
+    static AnchorPtr<T> sum(const std::vector<AnchorPtr<T>> &inputs);
+
+    /**
+     * Creates an Anchor that folds any number of input Anchors with an
+     * invertible operation, such as a count or a product of non-zero values.
+     * When inputs change, `remove` takes their old values out of the result
+     * and `add` puts their new values in. See sum().
+     *
+     * ````cpp
+     * auto numLong(Anchors::fold<int, double>(
+     *     positions, 0,
+     *     [](const int &n, const double &p) { return n + (p > 0); },
+     *     [](const int &n, const double &p) { return n - (p > 0); }));
+     * ````
+     *
+     * @tparam T - type of the output Anchor.
+     * @tparam InputType - optional type of the input Anchors. Required only if
+     * this type is different from the output Anchor Type T.
+     * @param inputs - input Anchors.
+     * @param initial - value of the Anchor when there are no inputs.
+     * @param add - function adding an input value to the result.
+     * @param remove - inverse of `add`.
+     * @return a shared pointer to the created Anchor.
+     */
+    template <typename T, typename InputType = T>
+    static AnchorPtr<T> fold(
+        const std::vector<AnchorPtr<InputType>>              &inputs,
+        const T                                              &initial,
+        const typename FoldAnchor<T, InputType>::Accumulator &add,
+        const typename FoldAnchor<T, InputType>::Accumulator &remove);
+
+    /**
+     * Creates an Anchor that combines any number of input Anchors with an
+     * associative and commutative operation without an inverse, such as a
+     * minimum or a maximum. Partial results are kept in a balanced tree
+     * inside the Anchor, so each changed input costs O(log N) applications of
+     * `operation`.
+     *
+     * @tparam T - type of the Anchors.
+     * @param inputs - input Anchors.
+     * @param operation - function combining two values.
+     * @return a shared pointer to the created Anchor.
+     * @throws std::invalid_argument if `inputs` is empty.
+     */
+    template <typename T>
+    static AnchorPtr<T> reduce(
+        const std::vector<AnchorPtr<T>>           &inputs,
+        const typename ReduceAnchor<T>::Operation &operation);
+
+    /**
+     * Creates a selector over a key Anchor. The Anchors returned by
+     * `isSelected()` on the selector are true while the key has a given
+     * value. When the key changes from `a` to `b`, only the Anchors watching
+     * `a` and `b` are recomputed, however many keys are watched.
+     *
+     * ````cpp
+     * auto selected(Anchors::select(symbol));
+     * auto isIbm(selected->isSelected("IBM"));
+     * ````
+     *
+     * @tparam K - type of the key. It must be hashable with `boost::hash`.
+     * @param key - key Anchor.
+     * @return a shared pointer to the created selector.
+     */
+    template <typename K>
+    static std::shared_ptr<SelectorAnchor<K>> select(const AnchorPtr<K> &key);
+
+    /**
+     * Creates an Anchor that is false until the Engine's clock reaches
+     * `time`, and true from then on. See `Engine::advanceClock()`.
+     *
+     * @param time - time at which the Anchor becomes true.
+     * @return a shared pointer to the created Anchor.
+     */
+    static AnchorPtr<bool> at(Time time);
+
+    /**
+     * Creates an Anchor that becomes true once `delay` has elapsed on the
+     * Engine's clock since the Anchor was first observed.
+     *
+     * @param delay - time after which the Anchor becomes true.
+     * @return a shared pointer to the created Anchor.
+     */
+    static AnchorPtr<bool> after(std::chrono::nanoseconds delay);
+
+    /**
+     * Creates an Anchor whose value is `initial` until the Engine's clock
+     * reaches the time of the first step, and then the value of the latest
+     * step the clock reached. The Engine only visits the Anchor when its
+     * clock passes one of the steps.
+     *
+     * @tparam T - type of the Anchor. `T` should overload the equality and
+     * output operators if not already defined.
+     * @param initial - value before the first step.
+     * @param steps - times at which the value changes, and the new values.
+     * @return a shared pointer to the created Anchor.
+     */
+    template <typename T>
+    static AnchorPtr<T> stepFunction(const T                        &initial,
+                                     std::vector<std::pair<Time, T>> steps);
 };
 
 template <typename T>
@@ -149,6 +357,32 @@ AnchorPtr<T> Anchors::map(
     return newAnchor;
 }
 
+template <typename T, typename InputType1>
+AnchorPtr<T> Anchors::map(
+    const AnchorPtr<InputType1>                              &anchor,
+    const typename Anchor<T, InputType1>::SingleInputUpdater &updater,
+    const MemoOptions                                        &options) {
+    auto cache = std::make_shared<MemoCache<InputType1, T>>(options);
+
+    auto memoizedUpdater = [cache, updater](InputType1 &input) {
+        if (const T *cachedValue = cache->find(input)) {
+            return *cachedValue;
+        }
+
+        // The updater may modify its input, so the key is copied first.
+        InputType1 key(input);
+        T          value = updater(input);
+        cache->insert(key, value);
+        return value;
+    };
+
+    auto newAnchor(
+        std::make_shared<Anchor<T, InputType1>>(anchor, memoizedUpdater));
+    newAnchor->d_memoCache = cache;
+
+    return newAnchor;
+}
+
 template <typename T, typename InputType1, typename InputType2>
 AnchorPtr<T> Anchors::map2(
     const AnchorPtr<InputType1> &anchor1,
@@ -161,6 +395,36 @@ AnchorPtr<T> Anchors::map2(
     return newAnchor;
 }
 
+template <typename T, typename InputType1, typename InputType2>
+AnchorPtr<T> Anchors::map2(
+    const AnchorPtr<InputType1> &anchor1,
+    const AnchorPtr<InputType2> &anchor2,
+    const typename Anchor<T, InputType1, InputType2>::DualInputUpdater
+                      &updater,
+    const MemoOptions &options) {
+    using KeyType = std::pair<InputType1, InputType2>;
+
+    auto cache = std::make_shared<MemoCache<KeyType, T>>(options);
+
+    auto memoizedUpdater = [cache, updater](InputType1 &input1,
+                                            InputType2 &input2) {
+        KeyType key(input1, input2);
+        if (const T *cachedValue = cache->find(key)) {
+            return *cachedValue;
+        }
+
+        T value = updater(input1, input2);
+        cache->insert(key, value);
+        return value;
+    };
+
+    auto newAnchor(std::make_shared<Anchor<T, InputType1, InputType2>>(
+        anchor1, anchor2, memoizedUpdater));
+    newAnchor->d_memoCache = cache;
+
+    return newAnchor;
+}
+
 template <typename T,
           typename InputType1,
           typename InputType2,
@@ -173,8 +437,8 @@ AnchorPtr<T> Anchors::map3(
     using PairType = std::pair<InputType1, InputType2>;
 
     const auto &anchorOfPair(map2<PairType, InputType1, InputType2>(
-        anchor1, anchor2, [](InputType1 t1, InputType2 t2) {
-            return std::make_pair(t1, t2);
+        anchor1, anchor2, [](InputType1 &t1, InputType2 &t2) {
+            return std::make_pair(std::move(t1), std::move(t2));
         }));
 
     const auto &newUpdater = [updater](PairType &pair, InputType3 &anchor3) {
@@ -200,13 +464,13 @@ AnchorPtr<T> Anchors::map4(
     using PairType2 = std::pair<InputType3, InputType4>;
 
     const auto &anchorOfPair1(map2<PairType1, InputType1, InputType2>(
-        anchor1, anchor2, [](InputType1 t1, InputType2 t2) {
-            return std::make_pair(t1, t2);
+        anchor1, anchor2, [](InputType1 &t1, InputType2 &t2) {
+            return std::make_pair(std::move(t1), std::move(t2));
         }));
 
     const auto &anchorOfPair2(map2<PairType2, InputType3, InputType4>(
-        anchor3, anchor4, [](InputType1 t1, InputType2 t2) {
-            return std::make_pair(t1, t2);
+        anchor3, anchor4, [](InputType3 &t3, InputType4 &t4) {
+            return std::make_pair(std::move(t3), std::move(t4));
         }));
 
     const auto &newUpdater = [updater](PairType1 &firstPair,
@@ -221,5 +485,80 @@ AnchorPtr<T> Anchors::map4(
         anchorOfPair1, anchorOfPair2, newUpdater);
 }
 
+template <typename T, typename InputType1>
+AnchorPtr<T> Anchors::mapAsync(
+    const AnchorPtr<InputType1> &anchor,
+    const typename AsyncAnchor<T, InputType1>::AsyncSingleInputUpdater
+        &updater) {
+    AnchorPtr<T> newAnchor(
+        std::make_shared<AsyncAnchor<T, InputType1>>(anchor, updater));
+
+    return newAnchor;
+}
+
+template <typename T, typename InputType1, typename InputType2>
+AnchorPtr<T> Anchors::mapAsync2(
+    const AnchorPtr<InputType1> &anchor1,
+    const AnchorPtr<InputType2> &anchor2,
+    const typename AsyncAnchor<T, InputType1, InputType2>::AsyncDualInputUpdater
+        &updater) {
+    AnchorPtr<T> newAnchor(
+        std::make_shared<AsyncAnchor<T, InputType1, InputType2>>(
+            anchor1, anchor2, updater));
+
+    return newAnchor;
+}
+
+template <typename T>
+AnchorPtr<T> Anchors::sum(const std::vector<AnchorPtr<T>> &inputs) {
+    return fold<T, T>(
+        inputs,
+        T(),
+        [](const T &total, const T &value) { return total + value; },
+        [](const T &total, const T &value) { return total - value; });
+}
+
+template <typename T, typename InputType>
+AnchorPtr<T> Anchors::fold(
+    const std::vector<AnchorPtr<InputType>>              &inputs,
+    const T                                              &initial,
+    const typename FoldAnchor<T, InputType>::Accumulator &add,
+    const typename FoldAnchor<T, InputType>::Accumulator &remove) {
+    return std::make_shared<FoldAnchor<T, InputType>>(
+        inputs, initial, add, remove);
+}
+
+template <typename T>
+AnchorPtr<T> Anchors::reduce(
+    const std::vector<AnchorPtr<T>>           &inputs,
+    const typename ReduceAnchor<T>::Operation &operation) {
+    return std::make_shared<ReduceAnchor<T>>(inputs, operation);
+}
+
+template <typename K>
+std::shared_ptr<SelectorAnchor<K>> Anchors::select(const AnchorPtr<K> &key) {
+    return std::make_shared<SelectorAnchor<K>>(key);
+}
+
+template <typename T>
+AnchorPtr<T> Anchors::stepFunction(const T                        &initial,
+                                   std::vector<std::pair<Time, T>> steps) {
+    AnchorPtr<T> newAnchor(
+        std::make_shared<TimeAnchor<T>>(initial, std::move(steps)));
+
+    return newAnchor;
+}
+
+#define ANCHORS_INSTANTIATE_ANCHORS(EXTERN, T)                                 \
+    EXTERN template AnchorPtr<T> Anchors::create<T>(const T &);                \
+    EXTERN template AnchorPtr<T> Anchors::map<T, T>(                           \
+        const AnchorPtr<T> &, const Anchor<T>::SingleInputUpdater &);          \
+    EXTERN template AnchorPtr<T> Anchors::map2<T, T, T>(                       \
+        const AnchorPtr<T> &,                                                  \
+        const AnchorPtr<T> &,                                                  \
+        const Anchor<T>::DualInputUpdater &);
+
+ANCHORS_FOR_EACH_COMMON_TYPE(ANCHORS_INSTANTIATE_ANCHORS, extern)
+
 }  // namespace anchors
 #endif  // ANCHORS_ANCHORS_H
@@ -0,0 +1,155 @@
+// asyncanchor.h
+#ifndef ANCHORS_ASYNCANCHOR_H
+#define ANCHORS_ASYNCANCHOR_H
+
+#include "anchor.h"
+
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace anchors {
+
+/**
+ * An Anchor whose updater function runs asynchronously and returns a
+ * `std::future` instead of a value.
+ *
+ * During stabilization, the Engine starts every stale AsyncAnchor at a given
+ * height before waiting on any of them, so slow, I/O-bound updaters at the same
+ * height overlap and the latency of that height is bounded by the slowest call.
+ *
+ * @tparam T - type of the Anchor's value
+ * @tparam InputType1 - optional type of the first input Anchor, if applicable.
+ * @tparam InputType2 - optional type of the second input Anchor, if applicable.
+ */
+template <typename T, typename InputType1 = T, typename InputType2 = T>
+class AsyncAnchor : public Anchor<T, InputType1, InputType2> {
+   public:
+    /**
+     * Alias for function that accepts an input of type `InputType1` and returns
+     * a future holding a value of type `T`.
+     */
+    using AsyncSingleInputUpdater =
+        std::function<std::future<T>(InputType1&)>;
+
+    /**
+     * Alias for function that accepts inputs of type `InputType1` and
+     * `InputType2` and returns a future holding a value of type `T`.
+     */
+    using AsyncDualInputUpdater =
+        std::function<std::future<T>(InputType1&, InputType2&)>;
+
+    /**
+     * Creates an AsyncAnchor from an input Anchor. See Anchors::mapAsync()
+     *
+     * @param input - input Anchor.
+     * @param updater - function that asynchronously maps the input Anchor to
+     * the output.
+     */
+    explicit AsyncAnchor(const std::shared_ptr<AnchorWrap<InputType1>>& input,
+                         const AsyncSingleInputUpdater& updater);
+
+    /**
+     * Creates an AsyncAnchor from two input Anchors. See Anchors::mapAsync2()
+     *
+     * @param firstInput - first input Anchor.
+     * @param secondInput - second input Anchor.
+     * @param updater - function that asynchronously maps the input Anchors to
+     * the output.
+     */
+    explicit AsyncAnchor(
+        const std::shared_ptr<AnchorWrap<InputType1>>& firstInput,
+        const std::shared_ptr<AnchorWrap<InputType2>>& secondInput,
+        const AsyncDualInputUpdater&                   updater);
+
+    ~AsyncAnchor() override = default;
+
+    friend class Engine;
+
+   private:
+    // PRIVATE MANIPULATORS
+    void startCompute(int stabilizationNumber) override;
+    // Invokes the updater function with the current values of the inputs and
+    // stores the returned future without waiting for it.
+
+    void compute(int stabilizationNumber) override;
+    // Waits for the future returned by the updater function, starting it first
+    // if `startCompute()` was not called, and stores the result.
+
+    void cancelCompute() override;
+    // Discards the future stored by `startCompute()`.
+
+    // PRIVATE DATA
+    AsyncSingleInputUpdater d_asyncSingleInputUpdater;
+
+    AsyncDualInputUpdater d_asyncDualInputUpdater;
+
+    std::future<T> d_pendingValue;
+    // Result of the updater call started by `startCompute()`, if any.
+};
+
+template <typename T, typename InputType1, typename InputType2>
+AsyncAnchor<T, InputType1, InputType2>::AsyncAnchor(
+    const std::shared_ptr<AnchorWrap<InputType1>>& input,
+    const AsyncSingleInputUpdater&                 updater)
+    : Anchor<T, InputType1, InputType2>(
+          input,
+          typename Anchor<T, InputType1, InputType2>::SingleInputUpdater()),
+      d_asyncSingleInputUpdater(updater) {}
+
+template <typename T, typename InputType1, typename InputType2>
+AsyncAnchor<T, InputType1, InputType2>::AsyncAnchor(
+    const std::shared_ptr<AnchorWrap<InputType1>>& firstInput,
+    const std::shared_ptr<AnchorWrap<InputType2>>& secondInput,
+    const AsyncDualInputUpdater&                   updater)
+    : Anchor<T, InputType1, InputType2>(
+          firstInput,
+          secondInput,
+          typename Anchor<T, InputType1, InputType2>::DualInputUpdater()),
+      d_asyncDualInputUpdater(updater) {}
+
+template <typename T, typename InputType1, typename InputType2>
+void AsyncAnchor<T, InputType1, InputType2>::startCompute(
+    int stabilizationNumber) {
+    if (this->d_recomputeId == stabilizationNumber) {
+        return;
+    }
+
+    if (this->d_numDependencies == 1) {
+        InputType1 inputVal = this->d_firstDependency->get();
+        d_pendingValue      = d_asyncSingleInputUpdater(inputVal);
+    } else {
+        InputType1 inputVal  = this->d_firstDependency->get();
+        InputType2 inputVal2 = this->d_secondDependency->get();
+
+        d_pendingValue = d_asyncDualInputUpdater(inputVal, inputVal2);
+    }
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void AsyncAnchor<T, InputType1, InputType2>::compute(int stabilizationNumber) {
+    if (this->d_recomputeId == stabilizationNumber) {
+        // Don't compute a node more than once in the same cycle
+        return;
+    }
+
+    if (!d_pendingValue.valid()) {
+        startCompute(stabilizationNumber);
+    }
+
+    T newValue = d_pendingValue.get();
+
+    this->d_recomputeId          = stabilizationNumber;
+    this->d_hasNeverBeenComputed = false;
+
+    this->updateValue(std::move(newValue), stabilizationNumber);
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void AsyncAnchor<T, InputType1, InputType2>::cancelCompute() {
+    d_pendingValue = std::future<T>();
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_ASYNCANCHOR_H
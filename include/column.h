@@ -0,0 +1,239 @@
+// column.h
+#ifndef ANCHORS_COLUMN_H
+#define ANCHORS_COLUMN_H
+
+#include "serializer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * A contiguous column of numeric values, or lanes, held by a single Anchor.
+ * See Columns.
+ *
+ * Lanes are grouped in blocks of `k_BLOCK_SIZE`, and each block carries a
+ * version that changes whenever one of its lanes is modified. Anchors computed
+ * from columns use these versions to recompute only the blocks whose inputs
+ * changed.
+ *
+ * Copies of a Column share their buffer until one of them is modified, so
+ * copying a Column into and out of an Anchor is cheap. Use
+ * `Engine::update()` to modify lanes of an input Anchor in place.
+ *
+ * @tparam T - arithmetic type of the lanes.
+ */
+template <typename T>
+class Column {
+    static_assert(std::is_arithmetic_v<T>,
+                  "anchors::Column only supports arithmetic types");
+
+   public:
+    /**
+     * Number of lanes in a block.
+     */
+    static constexpr std::size_t k_BLOCK_SIZE = 64;
+
+    /**
+     * Creates an empty Column.
+     */
+    Column() = default;
+
+    /**
+     * Creates a Column of `size` lanes, all set to `value`.
+     */
+    explicit Column(std::size_t size, T value = T());
+
+    /**
+     * Creates a Column holding `values`.
+     */
+    explicit Column(std::vector<T> values);
+
+    /**
+     * Returns the number of lanes.
+     */
+    std::size_t size() const;
+
+    /**
+     * Returns the number of blocks, the last of which may be partial.
+     */
+    std::size_t numBlocks() const;
+
+    /**
+     * Returns a pointer to the first lane.
+     */
+    const T* data() const;
+
+    const T& operator[](std::size_t lane) const;
+
+    /**
+     * Returns the version of the given block. Versions are unique across all
+     * Columns, so a block with the same version as before holds the same
+     * values.
+     */
+    std::uint64_t blockVersion(std::size_t block) const;
+
+    /**
+     * Sets the value of a lane, first copying the buffer if it is shared with
+     * another Column.
+     *
+     * @throws std::out_of_range if `lane` is not less than `size()`.
+     */
+    void setLane(std::size_t lane, T value);
+
+    /**
+     * Returns a pointer to the first lane of the given block and gives the
+     * block a new version, first copying the buffer if it is shared with
+     * another Column.
+     */
+    T* mutableBlock(std::size_t block);
+
+    friend bool operator==(const Column& lhs, const Column& rhs) {
+        if (lhs.d_data == rhs.d_data) {
+            return true;
+        }
+
+        return lhs.size() == rhs.size() &&
+               std::equal(lhs.data(), lhs.data() + lhs.size(), rhs.data());
+    }
+
+    friend bool operator!=(const Column& lhs, const Column& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const Column& column) {
+        out << "[";
+        for (std::size_t i = 0; i < column.size(); i++) {
+            out << (i == 0 ? "" : ", ") << column[i];
+        }
+        out << "]";
+
+        return out;
+    }
+
+   private:
+    // PRIVATE TYPES
+    struct Data {
+        std::vector<T> d_values;
+
+        std::vector<std::uint64_t> d_blockVersions;
+    };
+
+    // PRIVATE CLASS METHODS
+    static std::uint64_t nextVersion();
+    // Returns a version that has never been returned before.
+
+    // PRIVATE MANIPULATORS
+    void detach();
+    // Copies the buffer if it is shared with another Column.
+
+    // PRIVATE DATA
+    std::shared_ptr<Data> d_data;
+    // Lanes and block versions, or null for an empty Column.
+};
+
+template <typename T>
+Column<T>::Column(std::size_t size, T value)
+    : Column(std::vector<T>(size, value)) {}
+
+template <typename T>
+Column<T>::Column(std::vector<T> values) : d_data(std::make_shared<Data>()) {
+    const std::size_t numBlocks =
+        (values.size() + k_BLOCK_SIZE - 1) / k_BLOCK_SIZE;
+
+    d_data->d_values = std::move(values);
+    d_data->d_blockVersions.assign(numBlocks, nextVersion());
+}
+
+template <typename T>
+std::size_t Column<T>::size() const {
+    return d_data ? d_data->d_values.size() : 0;
+}
+
+template <typename T>
+std::size_t Column<T>::numBlocks() const {
+    return d_data ? d_data->d_blockVersions.size() : 0;
+}
+
+template <typename T>
+const T* Column<T>::data() const {
+    return d_data ? d_data->d_values.data() : nullptr;
+}
+
+template <typename T>
+const T& Column<T>::operator[](std::size_t lane) const {
+    return d_data->d_values[lane];
+}
+
+template <typename T>
+std::uint64_t Column<T>::blockVersion(std::size_t block) const {
+    return d_data->d_blockVersions[block];
+}
+
+template <typename T>
+void Column<T>::setLane(std::size_t lane, T value) {
+    if (lane >= size()) {
+        throw std::out_of_range("anchors::Column: lane out of range");
+    }
+
+    if (d_data->d_values[lane] != value) {
+        mutableBlock(lane / k_BLOCK_SIZE)[lane % k_BLOCK_SIZE] = value;
+    }
+}
+
+template <typename T>
+T* Column<T>::mutableBlock(std::size_t block) {
+    detach();
+    d_data->d_blockVersions[block] = nextVersion();
+
+    return d_data->d_values.data() + block * k_BLOCK_SIZE;
+}
+
+template <typename T>
+std::uint64_t Column<T>::nextVersion() {
+    static std::atomic<std::uint64_t> version{0};
+    return ++version;
+}
+
+template <typename T>
+void Column<T>::detach() {
+    if (d_data.use_count() > 1) {
+        d_data = std::make_shared<Data>(*d_data);
+    }
+}
+
+template <typename T>
+struct Serializer<Column<T>> {
+    static constexpr bool isSupported = true;
+
+    static void write(std::vector<char>& buffer, const Column<T>& value) {
+        Serializer<std::size_t>::write(buffer, value.size());
+        serializer::writeBytes(buffer, value.data(), value.size() * sizeof(T));
+    }
+
+    static Column<T> read(const char*& cursor, const char* end) {
+        std::size_t size = Serializer<std::size_t>::read(cursor, end);
+        if (size > static_cast<std::size_t>(end - cursor) / sizeof(T)) {
+            throw std::out_of_range("anchors::Serializer: truncated snapshot");
+        }
+
+        std::vector<T> values(size);
+        serializer::readBytes(
+            cursor, end, values.data(), values.size() * sizeof(T));
+
+        return Column<T>(std::move(values));
+    }
+};
+
+}  // namespace anchors
+
+#endif  // ANCHORS_COLUMN_H
@@ -4,13 +4,42 @@
 
 #include "anchor.h"
 #include "anchorutil.h"
+#include "timerwheel.h"
 
+#include <any>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <queue>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace anchors {
 
+class InputFeedBase;
+
+class Recorder;
+
+template <typename T>
+class Observer;
+
+class Scenario;
+
 /**
  * Engine is the brain of %Anchors, containing the necessary functions and data
  * to retrieve the value of an `Anchor` object. Note that this class is not
@@ -18,11 +47,43 @@ namespace anchors {
  */
 class Engine {
    public:
+    /**
+     * Default size of the scratch memory resource. See `scratchResource()`.
+     */
+    static constexpr std::size_t k_DEFAULT_SCRATCH_SIZE = 64 * 1024;
+
     /**
      * Creates an instance of the Engine class.
      */
     Engine();
 
+    /**
+     * Creates an instance of the Engine class whose memory comes from
+     * `resource`.
+     *
+     * The Engine's own containers allocate from a pool on top of `resource`,
+     * which recycles their memory, and the Engine reserves `scratchSize` bytes
+     * up front for its scratch memory resource, which updaters can obtain with
+     * `scratchResource()` while it stabilizes. The scratch resource is reset
+     * at the end of each call that stabilizes the Engine, including one
+     * stopped early by a `StabilizationLimit`; allocations beyond
+     * `scratchSize` within one call go to `resource`.
+     *
+     * @param resource - resource supplying the Engine's memory.
+     * @param scratchSize - size of the scratch memory resource, in bytes.
+     */
+    explicit Engine(std::pmr::memory_resource* resource,
+                    std::size_t scratchSize = k_DEFAULT_SCRATCH_SIZE);
+
+    Engine(const Engine&) = delete;
+
+    Engine& operator=(const Engine&) = delete;
+
+    /**
+     * Destroys the Engine, stopping its stabilizer thread if it runs.
+     */
+    ~Engine();
+
     /**
      * Returns the value of the given Anchor. This function is only guaranteed
      * to return the latest value of an Anchor marked observed using
@@ -31,7 +92,8 @@ class Engine {
      * For an unobserved Anchor, it may return a stale value—if the Anchor was
      * created with a value or has been computed before—or an undefined value if
      * the Anchor was created with a function e.g. using `Anchors::map`, and has
-     * not been computed before.
+     * not been computed before. Use `peek()` to read an unobserved Anchor's
+     * up-to-date value.
      *
      * @tparam T - type of the Anchor value.
      * @param anchor - input Anchor.
@@ -40,6 +102,111 @@ class Engine {
     template <typename T>
     T get(const AnchorPtr<T>& anchor);
 
+    /**
+     * Returns the value of the given Anchor once the stabilizer thread has
+     * completed a stabilization that includes the change with the given
+     * number. See `startStabilizer()` and `changeNumber()`. Without a
+     * stabilizer thread, this is the same as `get(anchor)`.
+     *
+     * @tparam T - type of the Anchor value.
+     * @param anchor - input Anchor.
+     * @param changeNumber - number of the change to wait for.
+     * @return the value of the input Anchor.
+     * @throws any exception thrown by an updater on the stabilizer thread
+     * since the last call to `get()`.
+     */
+    template <typename T>
+    T get(const AnchorPtr<T>& anchor, std::uint64_t changeNumber);
+
+    /**
+     * Returns the up-to-date value of the given Anchor, whether or not it is
+     * observed. The observed Anchors it depends on are brought up-to-date as
+     * `get()` would, and the other Anchors it depends on are computed if their
+     * inputs changed since they were last computed.
+     *
+     * Unlike observing the Anchor, reading it and unobserving it, this leaves
+     * no state behind, so an ad-hoc query only costs the computations it
+     * needs. The Anchor isn't kept up-to-date afterwards. With a stabilizer
+     * thread, it waits for the latest change to be stabilized first.
+     *
+     * @tparam T - type of the Anchor value.
+     * @param anchor - input Anchor.
+     * @return the up-to-date value of the input Anchor.
+     */
+    template <typename T>
+    T peek(const AnchorPtr<T>& anchor);
+
+    /**
+     * Returns true if the given Anchor is observed and its value is up-to-date,
+     * i.e. `get()` would return it without recomputing anything.
+     *
+     * @tparam T - type of the Anchor value.
+     * @param anchor - input Anchor.
+     */
+    template <typename T>
+    bool isUpToDate(const AnchorPtr<T>& anchor) const;
+
+    /**
+     * Brings observed Anchors up-to-date, stopping after at most `maxSteps`
+     * Anchors have been recomputed. A stabilization that stops early is
+     * resumed by the next call to `stabilizeSteps()`, `stabilizeFor()` or
+     * `get()`.
+     *
+     * While a stabilization is incomplete, `get()` on an observed Anchor
+     * finishes only the work needed to bring that Anchor up-to-date.
+     *
+     * @param maxSteps - maximum number of Anchors to recompute.
+     * @return true if stabilization finished.
+     */
+    bool stabilizeSteps(std::size_t maxSteps);
+
+    /**
+     * Brings observed Anchors up-to-date, stopping once `budget` has elapsed.
+     * See `stabilizeSteps()`. The budget is checked between Anchors of
+     * different heights, so a single height is never interrupted.
+     *
+     * @param budget - time after which to stop.
+     * @return true if stabilization finished.
+     */
+    bool stabilizeFor(std::chrono::nanoseconds budget);
+
+    /**
+     * Returns true if no observed Anchor is waiting to be recomputed.
+     */
+    bool isStabilized() const;
+
+    /**
+     * Starts a thread that brings observed Anchors up-to-date as soon as they
+     * change, so that `get()` no longer recomputes anything.
+     *
+     * While the stabilizer runs, `set()`, `update()`, `observe()`,
+     * `unobserve()` and `get()` may be called from any thread. Each change
+     * wakes the stabilizer, which waits for `coalescingDelay` so that changes
+     * made in quick succession are stabilized together. `get()` returns the
+     * value from the latest completed stabilization, waiting only while a
+     * stabilization is in progress. The other functions of the Engine, and
+     * Observers, must not be used until the stabilizer is stopped.
+     *
+     * @param coalescingDelay - time to wait after a change before stabilizing.
+     */
+    void startStabilizer(
+        std::chrono::nanoseconds coalescingDelay = std::chrono::nanoseconds(0));
+
+    /**
+     * Stops the stabilizer thread after its current stabilization. Must not be
+     * called while other threads use the Engine, including by pushing to a
+     * registered InputFeed.
+     */
+    void stopStabilizer();
+
+    /**
+     * Returns the number of changes made through `set()`, `update()` and
+     * `observe()` since the stabilizer thread started, or 0 if it does not
+     * run. Pass it to `get()` to wait for the changes made so far, including
+     * the updates pushed to registered feeds before this call.
+     */
+    std::uint64_t changeNumber() const;
+
     /**
      * Sets the value of the given Anchor. If the provided value is different
      * from the current value of the Anchor, any observed Anchors that depends
@@ -49,28 +216,61 @@ class Engine {
      * @tparam T - type of the Anchor value.
      * @param anchor - input Anchor.
      * @param val - new value of the Anchor.
+     * @throws std::logic_error if the Anchor is frozen, see `freeze()`, or is
+     * a TimeAnchor, whose value follows the clock.
      */
     template <typename T>
     void set(AnchorPtr<T>& anchor, T val);
 
+    /**
+     * Modifies the value of the given Anchor in place and marks it as
+     * changed. Unlike `set()`, this avoids building a whole new value, which
+     * matters for large values such as a Column in which only a few lanes
+     * change.
+     *
+     * @tparam T - type of the Anchor value.
+     * @param anchor - input Anchor.
+     * @param modifier - function called with a `T&` referring to the value.
+     * @throws std::logic_error if the Anchor is frozen, see `freeze()`, or is
+     * a TimeAnchor, whose value follows the clock.
+     */
+    template <typename T, typename Modifier>
+    void update(AnchorPtr<T>& anchor, Modifier&& modifier);
+
     /**
      * Marks an Anchor as observed. An observed Anchor is guaranteed to be up to
      * date when you retrieve its value.
      *
+     * Stabilization brings the dependencies of higher-priority observed
+     * Anchors up-to-date first. Retrieving the value of an observed Anchor
+     * only recomputes the Anchors with the same or a higher priority that are
+     * waiting to be recomputed; the rest is deferred until the Anchors that
+     * need it are retrieved or `stabilizeSteps()` or `stabilizeFor()` is
+     * called.
+     *
+     * Observing an Anchor that is already observed updates its priority.
+     *
      * @tparam T - type of the Anchor value.
      * @param anchor - input Anchor.
+     * @param priority - priority of the Anchor. Higher values are recomputed
+     * first.
+     * @return a handle that reads the value of the Anchor without looking it
+     * up. See `Observer`.
      */
     template <typename T>
-    void observe(AnchorPtr<T>& anchor);
+    Observer<T> observe(AnchorPtr<T>& anchor, int priority = 0);
 
     /**
-     * Marks a vector of Anchors with the same type as observed.
+     * Marks a vector of Anchors with the same type as observed. This is
+     * cheaper than observing them one by one, as the Anchors they depend on
+     * are only reordered in the recompute heap once.
      *
      * @tparam T - type of the Anchors.
      * @param anchors - input Anchors.
+     * @param priority - priority of the Anchors. See `observe()`.
      */
     template <typename T>
-    void observe(std::vector<AnchorPtr<T>>& anchors);
+    void observe(std::vector<AnchorPtr<T>>& anchors, int priority = 0);
 
     /**
      * Marks an Anchor as unobserved.
@@ -80,106 +280,817 @@ class Engine {
     template <typename T>
     void unobserve(AnchorPtr<T>& anchor);
 
+    /**
+     * Declares that the value of an Anchor, and of every Anchor it depends
+     * on, will never change again. The Anchors are brought up-to-date once,
+     * then no longer checked for staleness, scheduled for recomputation or
+     * linked to their dependants.
+     *
+     * An Anchor whose dependencies are all frozen is frozen as well, as soon
+     * as the last of them is frozen or, if it isn't a dependency of an
+     * observed Anchor at that point, when it is next observed.
+     *
+     * @tparam T - type of the Anchor value.
+     * @param anchor - Anchor to freeze.
+     */
+    template <typename T>
+    void freeze(AnchorPtr<T>& anchor);
+
+    /**
+     * Moves the Engine's clock forward to `now` and updates the time Anchors
+     * whose value changes at or before `now`. See `Anchors::at()`,
+     * `Anchors::after()` and `Anchors::stepFunction()`.
+     *
+     * The Engine keeps a timer for the next change of each time Anchor that
+     * observed Anchors depend on, in a hierarchical timer wheel, so this only
+     * visits the time Anchors whose timers expire.
+     *
+     * @param now - new time of the clock.
+     * @throws std::invalid_argument if `now` is earlier than the current time
+     * of the clock.
+     */
+    void advanceClock(Time now);
+
+    /**
+     * Returns the current time of the Engine's clock, which is the epoch of
+     * `Time` until `advanceClock()` is first called.
+     */
+    Time now() const;
+
+    /**
+     * Starts a what-if scenario, which lasts until the returned Scenario is
+     * reverted or destroyed.
+     *
+     * During a scenario, the Engine copies the state of each Anchor before
+     * `set()`, `update()` or a recomputation first overwrites it. Inputs can
+     * be changed and Anchors read as usual, and stabilization only recomputes
+     * the Anchors affected by the changes. Reverting the scenario restores the
+     * copies, which costs O(Anchors touched) and recomputes nothing.
+     *
+     * Freezing Anchors and advancing the clock are not allowed during a
+     * scenario. Observing or unobserving Anchors is, but is not reverted.
+     *
+     * @return a handle to the scenario.
+     * @throws std::logic_error if a scenario is already active, or a Recorder
+     * is set, since a trace can't revert the changes made in a scenario.
+     */
+    Scenario beginScenario();
+
+    /**
+     * Compiles the Anchors that observed Anchors depend on into a static
+     * schedule, for graphs whose shape no longer changes.
+     *
+     * The schedule lists the Anchors in the order they are recomputed, with
+     * the dependants of each Anchor stored as indices into that list, and
+     * tracks the Anchors waiting to be recomputed in a bitmap. Stabilization
+     * then scans the bitmap forward instead of maintaining the recompute
+     * heap. Recomputation happens in the same order, and with the same
+     * results, as without a schedule.
+     *
+     * Observing, unobserving or freezing an Anchor discards the schedule and
+     * the Engine goes back to the recompute heap until `compile()` is called
+     * again.
+     */
+    void compile();
+
+    /**
+     * Returns true if the Engine stabilizes using a schedule built by
+     * `compile()`.
+     */
+    bool isCompiled() const;
+
+    /**
+     * Writes the state of every observed Anchor and its dependencies to a
+     * memory-mapped file at `path`, after bringing them up-to-date. The
+     * snapshot contains each Anchor's value, its recomputeId and changeId,
+     * and the current stabilization number.
+     *
+     * Values are encoded using `Serializer<T>`. Anchors whose type has no
+     * `Serializer` specialization are saved without a value.
+     *
+     * @param path - path of the snapshot file, which is overwritten if it
+     * exists.
+     */
+    void saveSnapshot(const std::string& path);
+
+    /**
+     * Restores the state saved by `saveSnapshot()` into the observed Anchors
+     * and their dependencies.
+     *
+     * The graph must have the same topology as when the snapshot was taken,
+     * and Anchors must have been observed in the same order. After loading,
+     * setting an input Anchor recomputes only the Anchors that depend on it,
+     * and Anchors saved without a value are recomputed when next needed.
+     *
+     * @param path - path of the snapshot file.
+     * @return true if the snapshot was loaded; false if the file does not
+     * exist or does not match the current graph, in which case no Anchor is
+     * modified.
+     * @throws std::out_of_range if the snapshot file is truncated, in which
+     * case no Anchor is modified either.
+     */
+    bool loadSnapshot(const std::string& path);
+
+    /**
+     * Registers an InputFeed whose pending updates are applied before each
+     * stabilization. The feed must outlive the Engine or be removed with
+     * `removeFeed()`. While the stabilizer thread runs, pushing to the feed
+     * wakes it, and the feed may be added or removed from any thread.
+     *
+     * @param feed - feed of updates to input Anchors.
+     */
+    void addFeed(InputFeedBase& feed);
+
+    /**
+     * Stops draining the given InputFeed. Updates still waiting in the feed
+     * are not applied.
+     *
+     * @param feed - a feed previously registered with `addFeed()`.
+     */
+    void removeFeed(InputFeedBase& feed);
+
+    /**
+     * Starts recording the `set()`, `update()`, `get()`, `observe()` and
+     * `unobserve()` calls of this Engine to a trace, or stops recording if
+     * `recorder` is null. The Anchors passed to these functions must have
+     * been created by the Recorder, which must outlive the recording.
+     *
+     * @param recorder - Recorder to write to.
+     * @throws std::logic_error if `recorder` is not null and a scenario is
+     * active. See `beginScenario()`.
+     */
+    void setRecorder(Recorder* recorder);
+
+    /**
+     * Time spent bringing observed Anchors up-to-date when retrieving their
+     * values with `get()`.
+     */
+    struct LatencyStats {
+        std::size_t count = 0;
+        // Number of calls to `get()` that had to recompute Anchors.
+
+        std::chrono::nanoseconds total{};
+        // Total time spent recomputing in these calls.
+
+        std::chrono::nanoseconds max{};
+        // Longest time spent recomputing in a single call.
+    };
+
+    /**
+     * Returns the time `get()` spent recomputing for observed Anchors with the
+     * given priority.
+     *
+     * @param priority - priority passed to `observe()`.
+     */
+    LatencyStats getLatency(int priority) const;
+
+    friend class ShardedEngine;
+
+    friend class InputFeedBase;
+
+    template <typename>
+    friend class Observer;
+
+    friend class Scenario;
+
    private:
     // PRIVATE TYPES
     template <class T>
-    using min_heap = std::priority_queue<T, std::vector<T>, std::greater<T>>;
+    class min_heap
+        : public std::priority_queue<T, std::pmr::vector<T>, std::greater<T>> {
+       public:
+        using std::priority_queue<T, std::pmr::vector<T>, std::greater<T>>::
+            priority_queue;
+
+        void reorder() {
+            std::make_heap(this->c.begin(), this->c.end(), this->comp);
+        }
+        // Restores the heap order after the priority of an element changed.
+
+        void clear() { this->c.clear(); }
+        // Removes all the elements.
+    };
+
+    struct ObservedNode {
+        unsigned long d_order;
+        // Order in which the Anchor was observed.
+
+        int d_priority;
+        // Priority the Anchor was observed with.
+    };
+
+    struct Schedule {
+        std::vector<std::shared_ptr<AnchorBase>> d_nodes;
+        // Necessary Anchors in the order they are recomputed.
+
+        std::unordered_map<const AnchorBase*, std::uint32_t> d_indices;
+        // Index of each Anchor in `d_nodes`.
+
+        std::vector<std::uint32_t> d_dependantOffsets;
+        std::vector<std::uint32_t> d_dependants;
+        // The dependants of `d_nodes[i]` are at indices
+        // `[d_dependantOffsets[i], d_dependantOffsets[i + 1])` of
+        // `d_dependants`.
+
+        std::vector<char> d_isKeyed;
+        // Whether the Anchor at each index reports only some of its
+        // dependants as changed, in which case those are scheduled instead.
+
+        std::vector<std::uint64_t> d_dirty;
+        // Bitmap of the Anchors waiting to be recomputed.
+
+        std::size_t d_firstDirtyWord = 0;
+        // No word of `d_dirty` before this one has a bit set.
+
+        std::vector<std::uint32_t> d_batch;
+        // Anchors recomputed together during stabilization.
+    };
+
+    struct Timer {
+        std::shared_ptr<AnchorBase> d_anchor;
+
+        TimeAnchorBase* d_timeAnchor;
+        // `d_anchor` as a TimeAnchor.
+    };
+
+    struct Stabilizer {
+        std::thread d_thread;
+
+        mutable std::mutex d_mutex;
+        // Held by the stabilizer thread while it stabilizes, and by other
+        // threads while they use the Engine.
+
+        std::condition_variable d_changed;
+
+        std::condition_variable d_stabilized;
+
+        std::chrono::nanoseconds d_coalescingDelay;
+
+        std::uint64_t d_changeNumber = 0;
+        // Number of changes made since the thread started.
+
+        std::uint64_t d_stabilizedNumber = 0;
+        // Number of changes included in the latest completed stabilization.
+
+        std::exception_ptr d_error;
+        // First exception thrown while stabilizing since the last `get()`.
+
+        bool d_stopping = false;
+    };
+
+    struct ScenarioState {
+        std::unordered_set<const AnchorBase*> d_copied;
+        // Anchors whose state was copied.
+
+        std::vector<std::pair<std::shared_ptr<AnchorBase>, std::any>> d_copies;
+        // State of each Anchor before it was first overwritten.
+
+        std::vector<std::shared_ptr<AnchorBase>> d_pending;
+        // Anchors waiting to be recomputed when the scenario started.
+    };
+
+    struct StabilizationLimit {
+        std::size_t d_maxSteps = std::numeric_limits<std::size_t>::max();
+        // Maximum number of Anchors to recompute.
+
+        std::chrono::steady_clock::time_point d_deadline =
+            std::chrono::steady_clock::time_point::max();
+        // Time after which to stop.
+
+        int d_minPriority = INT_MIN;
+        int d_maxHeight   = INT_MAX;
+        // Stop once every Anchor that is recomputed before an Anchor with this
+        // priority and height is up-to-date.
+
+        bool hasDeadline() const {
+            return d_deadline != std::chrono::steady_clock::time_point::max();
+        }
+        // Returns true if `d_deadline` is set, so stabilization only reads the
+        // clock when it has to.
+    };
 
     // PRIVATE MANIPULATORS
     void stabilize();
-    // Brings all observed Anchors up-to-date.
+    // Applies the updates waiting in registered feeds, then brings all
+    // observed Anchors up-to-date.
+
+    bool stabilize(const StabilizationLimit& limit);
+    // Applies the updates waiting in registered feeds, then brings observed
+    // Anchors up-to-date until `limit` is reached. Returns true if every
+    // observed Anchor is up-to-date.
 
     void observeNode(std::shared_ptr<AnchorBase>& current,
-                     std::unordered_set<std::shared_ptr<AnchorBase>>&);
+                     std::unordered_set<const AnchorBase*>&,
+                     int priority);
     // Marks all the dependencies of the given Anchor as necessary and adds
     // stale Anchors to the recompute heap;
 
-    void unobserveNode(std::shared_ptr<AnchorBase>& current);
+    void unobserveNode(std::shared_ptr<AnchorBase>& current,
+                       std::unordered_set<const AnchorBase*>&,
+                       int priority);
     // Removes `current` from the set of observed Anchors.
     // Also decrements the 'necessary' count and removes `current` as a
     // dependant of each of its dependencies.
 
+    void addObserver(const std::shared_ptr<AnchorBase>& anchor, int priority);
+    // Marks `anchor` as observed with the given priority.
+
+    void addObservers(std::span<const std::shared_ptr<AnchorBase>> anchors,
+                      int                                          priority);
+    // Marks each of `anchors` as observed with the given priority, then
+    // restores the order of the recompute heap if priorities changed.
+
+    void removeObserver(const std::shared_ptr<AnchorBase>& anchor);
+    // Marks `anchor` as unobserved.
+
+    void freezeCone(const std::shared_ptr<AnchorBase>& anchor);
+    // Brings `anchor` and its dependencies up-to-date and freezes them.
+
+    void saveForScenario(const std::shared_ptr<AnchorBase>& node);
+    // Copies the state of `node` if a scenario is active and it wasn't copied
+    // yet in this scenario.
+
+    void revertScenario();
+    // Restores the state of the Anchors copied during the active scenario
+    // and the recompute queue from before it started, then ends it.
+
+    void scheduleNode(const std::shared_ptr<AnchorBase>& node);
+    // Adds `node` to the recompute heap, or marks it in the schedule.
+
+    void freezeNode(const std::shared_ptr<AnchorBase>& node);
+    // Freezes an up-to-date `node`, unlinks it from its dependencies and
+    // dependants, schedules the dependants that are stale, and freezes those
+    // whose dependencies are now all frozen.
+
+    bool stabilizeHeap(const StabilizationLimit& limit);
+    // Recomputes the Anchors in the recompute heap until `limit` is reached.
+    // Returns true if the heap is empty.
+
+    bool stabilizeSchedule(const StabilizationLimit& limit);
+    // Recomputes the Anchors marked in the compiled schedule until `limit` is
+    // reached. Returns true if none is left.
+
+    void markDirty(std::uint32_t index);
+    // Marks the Anchor at `index` in the compiled schedule for recomputation.
+
+    void markDependantsDirty(std::uint32_t index);
+    // Marks the dependants of the Anchor at `index` in the compiled schedule
+    // for recomputation.
+
+    void decompile();
+    // Moves the Anchors waiting in the compiled schedule, if any, to the
+    // recompute heap and discards the schedule.
+
+    void scheduleTimer(const std::shared_ptr<AnchorBase>& anchor,
+                       TimeAnchorBase&                    timeAnchor);
+    // Brings the time Anchor `anchor` to the current time of the clock and
+    // adds a timer for its next change.
+
+    void runStabilizer();
+    // Body of the stabilizer thread: waits for changes and stabilizes.
+
+    std::unique_lock<std::mutex> lockStabilizer();
+    // Locks the Engine against the stabilizer thread if it runs and the
+    // caller is another thread. Returns an empty lock otherwise.
+
+    std::unique_lock<std::mutex> waitForStabilizer(std::uint64_t changeNumber);
+    // Locks the Engine once the stabilizer thread has stabilized the change
+    // with the given number, and rethrows any exception it caught.
+
+    void notifyStabilizer();
+    // Wakes the stabilizer thread, if it runs, after a change made by another
+    // thread. Must be called with the lock from `lockStabilizer()`.
+
+    void wakeStabilizer();
+    // Wakes the stabilizer thread if it waits for changes, after an update
+    // was pushed to a registered feed. Called without the lock.
+
+    void markInputChanged(const std::shared_ptr<AnchorBase>& anchor);
+    // Records that the value of the input `anchor` changed and schedules its
+    // necessary dependants for recomputation.
+
+    void stabilizeThrough(const std::shared_ptr<AnchorBase>& anchor);
+    // Recomputes every Anchor that must be recomputed before `anchor`, which
+    // brings `anchor` up-to-date, and records the time taken.
+
+    void computeCone(const std::shared_ptr<AnchorBase>& anchor);
+    // Brings `anchor` up-to-date without making it necessary: stabilizes
+    // the necessary Anchors it depends on, then computes the outdated Anchors
+    // among the others.
+
+    void recordSet(const AnchorBase& anchor);
+    // Records a change to the value of `anchor` if a Recorder is set.
+
+    void recordGet(const AnchorBase& anchor);
+    // Records a read of `anchor` if a Recorder is set.
+
+    void recordObserve(const AnchorBase& anchor, int priority);
+    // Records `anchor` being observed if a Recorder is set.
+
+    void recordUnobserve(const AnchorBase& anchor);
+    // Records `anchor` being unobserved if a Recorder is set.
+
+    void checkRecorded(const AnchorBase& anchor) const;
+    // Throws `std::invalid_argument` if `anchor` was not created by the
+    // Recorder, so that a change that can't be recorded isn't applied either.
+
+    bool refreshObserver(const std::shared_ptr<AnchorBase>& anchor);
+    // Brings the observed `anchor` up-to-date as `get()` does. Returns true if
+    // nothing is left to recompute, so that Observers can return the values
+    // of Anchors without calling the Engine until `d_epoch` changes.
+
+    // PRIVATE ACCESSORS
+    bool hasPendingWork() const;
+    // Returns true if an Anchor is waiting to be recomputed.
+
+    const std::shared_ptr<AnchorBase>* nextPending() const;
+    // Returns the next Anchor to be recomputed, or null if none is waiting.
+
+    bool hasFeedUpdates() const;
+    // Returns true if a registered feed has updates waiting to be drained.
+
+    std::vector<std::shared_ptr<AnchorBase>> snapshotNodes(
+        std::size_t& topologyHash) const;
+    // Returns the observed Anchors and their dependencies in a deterministic
+    // order: the dependencies of each observed Anchor, in order of
+    // observation, followed by the Anchor itself. Also computes a hash of the
+    // shape of the graph in `topologyHash`.
+
     // PRIVATE DATA
+    std::pmr::unsynchronized_pool_resource d_pool;
+    // Resource used by the containers below, so that the memory of the
+    // recompute heap and set is recycled from one stabilization to the next.
+
+    std::pmr::vector<std::byte> d_scratchBuffer;
+    // Initial buffer of the scratch resource.
+
+    std::pmr::monotonic_buffer_resource d_scratch;
+    // Scratch resource for updaters, reset after each call to `stabilize()`.
+
     int d_stabilizationNumber;
     // Current stabilization number of the engine. We use this number to
     // represent when an Anchor value was recomputed and/or changed.
 
-    std::unordered_set<std::shared_ptr<AnchorBase>> d_observedNodes;
-    // Set of observed Anchors.
+    std::pmr::unordered_map<std::shared_ptr<AnchorBase>, ObservedNode>
+        d_observedNodes;
+    // Observed Anchors.
+
+    unsigned long d_observationCount;
+    // Number of calls to `observe()` that marked an Anchor as observed.
 
     min_heap<std::shared_ptr<AnchorBase>> d_recomputeHeap;
     // Priority queue containing Anchors that need to be recomputed, in
-    // increasing order of their heights.
+    // decreasing order of their priorities and increasing order of their
+    // heights.
 
-    std::unordered_set<std::shared_ptr<AnchorBase>> d_recomputeSet;
+    std::pmr::unordered_set<std::shared_ptr<AnchorBase>> d_recomputeSet;
     // Set of Anchors present in the recompute queue.
 
+    std::pmr::vector<std::shared_ptr<AnchorBase>> d_batch;
+    // Anchors recomputed together during stabilization, kept between
+    // stabilizations to reuse its memory.
+
+    std::pmr::vector<InputFeedBase*> d_feeds;
+    // Feeds drained at the start of each stabilization.
+
+    bool d_isStabilizing;
+    // True if a stabilization was stopped before the recompute heap emptied.
+
+    std::size_t d_recomputeCount;
+    // Number of Anchors recomputed by stabilizations.
+
+    bool d_prioritiesChanged;
+    // True if observing or unobserving changed the priority of an Anchor,
+    // which requires reordering the recompute heap.
+
+    std::pmr::map<int, LatencyStats> d_latencies;
+    // Time spent recomputing in `get()`, by priority.
+
+    Recorder* d_recorder;
+    // Recorder of the operations on this Engine, or null.
+
+    std::unique_ptr<Schedule> d_schedule;
+    // Schedule built by `compile()`, or null. While it is set, Anchors that
+    // need to be recomputed are marked in it rather than added to the
+    // recompute heap.
+
+    Time d_now;
+    // Current time of the clock.
+
+    TimerWheel<Timer> d_timers;
+    // Timers for the next change of the necessary time Anchors, in
+    // nanoseconds.
+
+    std::unique_ptr<Stabilizer> d_stabilizer;
+    // State of the stabilizer thread, or null if it does not run.
+
+    std::atomic<bool> d_isStabilizerWaiting;
+    // True while the stabilizer thread waits for changes, so that feeds
+    // only take the lock to wake it.
+
+    std::uint64_t d_epoch;
+    // Incremented whenever the value of an observed Anchor may change, or an
+    // Observer must otherwise call the Engine on its next read.
+
+    std::unique_ptr<ScenarioState> d_scenario;
+    // State of the active scenario, or null if there is none.
+
     //    std::priority_queue<std::shared_ptr<AnchorBase>> d_adjustHeightsHeap;
     //    // Update the adjust-heights heap when setUpdater is called. Will use
     //    later.
 };
 
+/**
+ * A handle to a what-if scenario, returned by `Engine::beginScenario()`. The
+ * scenario is reverted when the handle is destroyed, unless `revert()` was
+ * called before.
+ *
+ * ````cpp
+ * {
+ *     Scenario scenario(engine.beginScenario());
+ *     engine.set(spot, 1.1 * engine.get(spot));
+ *     stressedPnl = engine.get(pnl);
+ * }
+ * ````
+ *
+ * A Scenario must not outlive the Engine that created it.
+ */
+class Scenario {
+   public:
+    Scenario(Scenario&& other) noexcept;
+
+    Scenario& operator=(Scenario&&) = delete;
+
+    /**
+     * Reverts the scenario if it is still active.
+     */
+    ~Scenario();
+
+    /**
+     * Restores every Anchor changed during the scenario to its state before
+     * the scenario started, and ends the scenario. Does nothing if it already
+     * ended.
+     */
+    void revert();
+
+    /**
+     * Returns true until the scenario is reverted.
+     */
+    bool isActive() const;
+
+   private:
+    // PRIVATE CREATORS
+    explicit Scenario(Engine& engine);
+
+    // PRIVATE DATA
+    Engine* d_engine;
+    // Engine running the scenario, or null once it ended.
+
+    friend class Engine;
+};
+
+/**
+ * A handle to an observed Anchor, returned by `Engine::observe()`, that reads
+ * the value of the Anchor in place.
+ *
+ * `Engine::get()` looks the Anchor up among the observed Anchors and returns
+ * a copy of its value. An Observer instead refers to the Anchor's value
+ * directly and remembers whether anything could have changed it since its
+ * last read: while nothing is waiting to be recomputed, `get()` is a
+ * comparison followed by a load. Otherwise, it brings the Anchor up-to-date
+ * the same way as `Engine::get()`.
+ *
+ * An Observer must not outlive the Engine that created it. Once the Anchor is
+ * unobserved, `get()` behaves as `Engine::get()` does for unobserved Anchors.
+ *
+ * @tparam T - type of the Anchor value.
+ */
+template <typename T>
+class Observer {
+   public:
+    /**
+     * Returns the up-to-date value of the observed Anchor. The reference is
+     * valid until the next call to a function of the Engine.
+     */
+    const T& get();
+
+    /**
+     * Returns the observed Anchor.
+     */
+    const AnchorPtr<T>& anchor() const;
+
+   private:
+    // PRIVATE CREATORS
+    Observer(Engine& engine, const AnchorPtr<T>& anchor, const T& value);
+
+    // PRIVATE MANIPULATORS
+    void refresh();
+    // Brings the Anchor up-to-date and records the Engine's current epoch if
+    // nothing else is left to recompute.
+
+    // PRIVATE DATA
+    Engine* d_engine;
+
+    AnchorPtr<T> d_anchor;
+
+    const T* d_value;
+    // Value of the Anchor.
+
+    std::uint64_t d_epoch;
+    // Epoch of the Engine at which the value was last known to be
+    // up-to-date, or one less than the Engine's epoch if it never was.
+
+    friend class Engine;
+};
+
+template <typename T>
+Observer<T>::Observer(Engine&             engine,
+                      const AnchorPtr<T>& anchor,
+                      const T&            value)
+    : d_engine(&engine),
+      d_anchor(anchor),
+      d_value(&value),
+      d_epoch(engine.d_epoch - 1) {}
+
+template <typename T>
+const T& Observer<T>::get() {
+    if (d_epoch != d_engine->d_epoch) [[unlikely]] {
+        refresh();
+    }
+
+    return *d_value;
+}
+
+template <typename T>
+const AnchorPtr<T>& Observer<T>::anchor() const {
+    return d_anchor;
+}
+
+template <typename T>
+void Observer<T>::refresh() {
+    if (d_engine->refreshObserver(d_anchor)) {
+        d_epoch = d_engine->d_epoch;
+    }
+}
+
 template <typename T>
 T Engine::get(const AnchorPtr<T>& anchor) {
+    if (d_stabilizer) {
+        return get(anchor, 0);
+    }
+
+    if (d_recorder) {
+        recordGet(*anchor);
+    }
+
     if (d_observedNodes.contains(anchor)) {
-        stabilize();
+        stabilizeThrough(anchor);
     }
 
     return anchor->get();
 }
 
+template <typename T>
+T Engine::get(const AnchorPtr<T>& anchor, std::uint64_t changeNumber) {
+    if (!d_stabilizer) {
+        return get(anchor);
+    }
+
+    auto lock = waitForStabilizer(changeNumber);
+    if (d_recorder) {
+        recordGet(*anchor);
+    }
+
+    return anchor->get();
+}
+
+template <typename T>
+T Engine::peek(const AnchorPtr<T>& anchor) {
+    auto lock = waitForStabilizer(changeNumber());
+    computeCone(anchor);
+
+    return anchor->get();
+}
+
+template <typename T>
+bool Engine::isUpToDate(const AnchorPtr<T>& anchor) const {
+    if (!d_observedNodes.contains(anchor) || anchor->isStale()) {
+        return false;
+    }
+
+    const std::shared_ptr<AnchorBase>* next = nextPending();
+    return !next ||
+           std::greater<std::shared_ptr<AnchorBase>>()(*next, anchor);
+}
+
 template <typename T>
 void Engine::set(AnchorPtr<T>& anchor, T val) {
-    T oldVal = anchor->get();
+    auto lock = lockStabilizer();
+    if (anchor->isFrozen()) {
+        throw std::logic_error("anchors::Engine: cannot set a frozen Anchor");
+    }
 
-    if (oldVal == val) return;
-    d_stabilizationNumber++;
+    if (anchor->d_isTimeAnchor) {
+        throw std::logic_error("anchors::Engine: cannot set a TimeAnchor");
+    }
 
-    anchor->setChangeId(d_stabilizationNumber);
-    anchor->set(val);
+    if (d_recorder) {
+        checkRecorded(*anchor);
+    }
 
-    if (anchor->isNecessary()) {
-        for (const auto& dependant : anchor->getDependants()) {
-            if (dependant->isNecessary() &&
-                !d_recomputeSet.contains(dependant)) {
-                d_recomputeHeap.push(dependant);
-                d_recomputeSet.insert(dependant);
-            }
-        }
+    if (!(anchor->getValueRef() == val)) {
+        saveForScenario(anchor);
+        anchor->set(std::move(val));
+        markInputChanged(anchor);
+        notifyStabilizer();
+    }
+
+    if (d_recorder) {
+        recordSet(*anchor);
+    }
+}
+
+template <typename T, typename Modifier>
+void Engine::update(AnchorPtr<T>& anchor, Modifier&& modifier) {
+    auto lock = lockStabilizer();
+    if (anchor->isFrozen()) {
+        throw std::logic_error("anchors::Engine: cannot set a frozen Anchor");
+    }
+
+    if (anchor->d_isTimeAnchor) {
+        throw std::logic_error("anchors::Engine: cannot set a TimeAnchor");
+    }
+
+    if (d_recorder) {
+        checkRecorded(*anchor);
+    }
+
+    saveForScenario(anchor);
+    std::forward<Modifier>(modifier)(anchor->getMutableValueRef());
+    markInputChanged(anchor);
+    notifyStabilizer();
+
+    if (d_recorder) {
+        recordSet(*anchor);
     }
 }
 
 template <typename T>
-void Engine::observe(AnchorPtr<T>& anchor) {
-    if (d_observedNodes.contains(anchor)) {
-        return;
+Observer<T> Engine::observe(AnchorPtr<T>& anchor, int priority) {
+    auto lock = lockStabilizer();
+    if (d_recorder) {
+        recordObserve(*anchor, priority);
     }
 
-    d_observedNodes.insert(anchor);
+    addObserver(anchor, priority);
+    notifyStabilizer();
 
-    std::unordered_set<std::shared_ptr<AnchorBase>> visited;
-    std::shared_ptr<AnchorBase>                     anchorBase = anchor;
-    observeNode(anchorBase, visited);
+    return Observer<T>(*this, anchor, anchor->getValueRef());
 }
 
 template <typename T>
-void Engine::observe(std::vector<AnchorPtr<T>>& anchors) {
-    for (auto& anchor : anchors) {
-        observe(anchor);
+void Engine::observe(std::vector<AnchorPtr<T>>& anchors, int priority) {
+    auto lock = lockStabilizer();
+    if (d_recorder) {
+        for (auto& anchor : anchors) {
+            recordObserve(*anchor, priority);
+        }
     }
+
+    std::vector<std::shared_ptr<AnchorBase>> nodes(anchors.begin(),
+                                                   anchors.end());
+    addObservers(nodes, priority);
+    notifyStabilizer();
 }
 
 template <typename T>
 void Engine::unobserve(AnchorPtr<T>& anchor) {
-    if (!d_observedNodes.contains(anchor)) {
-        return;
+    auto lock = lockStabilizer();
+    if (d_recorder) {
+        recordUnobserve(*anchor);
     }
 
-    d_observedNodes.erase(anchor);
+    removeObserver(anchor);
+}
 
-    std::shared_ptr<AnchorBase> anchorBase = anchor;
-    unobserveNode(anchorBase);
+template <typename T>
+void Engine::freeze(AnchorPtr<T>& anchor) {
+    freezeCone(anchor);
 }
 
+#define ANCHORS_INSTANTIATE_ENGINE(EXTERN, T)                                  \
+    EXTERN template class Observer<T>;                                         \
+    EXTERN template T Engine::get<T>(const AnchorPtr<T>&);                     \
+    EXTERN template T Engine::get<T>(const AnchorPtr<T>&, std::uint64_t);      \
+    EXTERN template T Engine::peek<T>(const AnchorPtr<T>&);                    \
+    EXTERN template bool Engine::isUpToDate<T>(const AnchorPtr<T>&) const;     \
+    EXTERN template void Engine::set<T>(AnchorPtr<T>&, T);                     \
+    EXTERN template Observer<T> Engine::observe<T>(AnchorPtr<T>&, int);        \
+    EXTERN template void Engine::observe<T>(std::vector<AnchorPtr<T>>&, int);  \
+    EXTERN template void Engine::unobserve<T>(AnchorPtr<T>&);                  \
+    EXTERN template void Engine::freeze<T>(AnchorPtr<T>&);
+
+ANCHORS_FOR_EACH_COMMON_TYPE(ANCHORS_INSTANTIATE_ENGINE, extern)
+
 }  // namespace anchors
 #endif
@@ -0,0 +1,168 @@
+// immutable.h
+#ifndef ANCHORS_IMMUTABLE_H
+#define ANCHORS_IMMUTABLE_H
+
+#include "memocache.h"
+#include "serializer.h"
+
+#include <boost/container_hash/hash.hpp>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * A value policy for Anchors holding large payloads, such as big
+ * `std::vector`s or `std::map`s.
+ *
+ * An `Immutable<T>` stores its value in a reference-counted buffer that is
+ * never modified, so copying it—into an Anchor, out of `Engine::get()`, into
+ * an updater's inputs, or into the intermediate Anchors built by
+ * `Anchors::map3()` and `Anchors::map4()`—only copies a pointer. A new value
+ * is created with `update()`, which copies the payload once.
+ *
+ * Two Immutables are equal if they share the same buffer, or else if their
+ * values are equal, so the check that stops unchanged values from propagating
+ * through the graph is a pointer comparison when a value is passed through
+ * unmodified.
+ *
+ * ````cpp
+ * auto orders(Anchors::create(Immutable(std::vector<int>{150, 200, 300})));
+ *
+ * auto total(Anchors::map<int, Immutable<std::vector<int>>>(
+ *     orders, [](const Immutable<std::vector<int>>& v) {
+ *         return std::accumulate(v->begin(), v->end(), 0);
+ *     }));
+ * ````
+ *
+ * @tparam T - type of the value. `T` should overload the equality operator.
+ */
+template <typename T>
+class Immutable {
+   public:
+    /**
+     * Creates an Immutable holding a default-constructed value, without
+     * allocating.
+     */
+    Immutable() = default;
+
+    /**
+     * Creates an Immutable holding `value`.
+     */
+    Immutable(T value);
+
+    /**
+     * Returns the value.
+     */
+    const T& get() const;
+
+    const T& operator*() const;
+
+    const T* operator->() const;
+
+    /**
+     * Returns a new Immutable holding a copy of this value modified by
+     * `modifier`, which is called with a `T&`.
+     */
+    template <typename Modifier>
+    Immutable update(Modifier&& modifier) const;
+
+    /**
+     * Returns true if `other` shares the same buffer as this Immutable.
+     */
+    bool isSameBuffer(const Immutable& other) const;
+
+    friend bool operator==(const Immutable& lhs, const Immutable& rhs) {
+        return lhs.d_value == rhs.d_value || lhs.get() == rhs.get();
+    }
+
+    friend bool operator!=(const Immutable& lhs, const Immutable& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend std::size_t hash_value(const Immutable& value) {
+        return boost::hash<T>()(value.get());
+    }
+
+   private:
+    // PRIVATE CLASS METHODS
+    static const T& defaultValue();
+    // Returns the value of a default-constructed Immutable.
+
+    // PRIVATE DATA
+    std::shared_ptr<const T> d_value;
+    // The value, or null for a default-constructed value.
+};
+
+template <typename T>
+Immutable<T>::Immutable(T value)
+    : d_value(std::make_shared<const T>(std::move(value))) {}
+
+template <typename T>
+const T& Immutable<T>::get() const {
+    return d_value ? *d_value : defaultValue();
+}
+
+template <typename T>
+const T& Immutable<T>::operator*() const {
+    return get();
+}
+
+template <typename T>
+const T* Immutable<T>::operator->() const {
+    return &get();
+}
+
+template <typename T>
+template <typename Modifier>
+Immutable<T> Immutable<T>::update(Modifier&& modifier) const {
+    T value(get());
+    std::forward<Modifier>(modifier)(value);
+
+    return Immutable(std::move(value));
+}
+
+template <typename T>
+bool Immutable<T>::isSameBuffer(const Immutable& other) const {
+    return d_value == other.d_value;
+}
+
+template <typename T>
+const T& Immutable<T>::defaultValue() {
+    static const T value{};
+    return value;
+}
+
+template <typename T>
+    requires requires(std::ostream& out, const T& value) { out << value; }
+std::ostream& operator<<(std::ostream& out, const Immutable<T>& value) {
+    out << value.get();
+    return out;
+}
+
+/**
+ * Counts the size of the pointer only, since the buffer is shared.
+ */
+template <typename T>
+std::size_t memoFootprint(const Immutable<T>& value) {
+    return sizeof(value);
+}
+
+template <typename T>
+struct Serializer<Immutable<T>, std::enable_if_t<Serializer<T>::isSupported>> {
+    static constexpr bool isSupported = true;
+
+    static void write(std::vector<char>& buffer, const Immutable<T>& value) {
+        Serializer<T>::write(buffer, value.get());
+    }
+
+    static Immutable<T> read(const char*& cursor, const char* end) {
+        return Immutable<T>(Serializer<T>::read(cursor, end));
+    }
+};
+
+}  // namespace anchors
+
+#endif  // ANCHORS_IMMUTABLE_H
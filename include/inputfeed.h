@@ -0,0 +1,215 @@
+// inputfeed.h
+#ifndef ANCHORS_INPUTFEED_H
+#define ANCHORS_INPUTFEED_H
+
+#include "anchorutil.h"
+#include "engine.h"
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * `InputFeedBase` represents an InputFeed without its type information, which
+ * allows the Engine to drain feeds of different types.
+ */
+class InputFeedBase {
+   public:
+    virtual ~InputFeedBase(){};
+
+   protected:
+    // PROTECTED MANIPULATORS
+    virtual void drain(Engine& engine) = 0;
+    // Sets the latest value received for each Anchor since the last call.
+
+    void wakeEngine();
+    // Wakes the stabilizer thread of the Engine the feed is registered with,
+    // if it waits for changes. Called by the producer after each update.
+
+    // PROTECTED ACCESSORS
+    virtual bool hasUpdates() const = 0;
+    // Returns true if updates are waiting to be drained.
+
+   private:
+    // DATA
+    std::atomic<Engine*> d_engine{nullptr};
+    // Engine the feed is registered with, or null.
+
+    friend class Engine;
+};
+
+inline void InputFeedBase::wakeEngine() {
+    if (Engine* engine = d_engine.load(std::memory_order_acquire)) {
+        engine->wakeStabilizer();
+    }
+}
+
+/**
+ * A lock-free, single-producer single-consumer queue of updates to input
+ * Anchors of type `T`.
+ *
+ * One thread pushes new values with `push()` while the Engine thread drains the
+ * feed before each stabilization, once the feed is registered with
+ * `Engine::addFeed()`. When several updates to the same Anchor are waiting,
+ * only the latest one is passed to `Engine::set()`. If the Engine runs a
+ * stabilizer thread, each push wakes it when it is waiting for changes.
+ *
+ * All the memory used by the feed is allocated up front: pushing and draining
+ * don't allocate, other than when copying values of `T` that allocate.
+ *
+ * @tparam T - type of the Anchors fed by this feed.
+ */
+template <typename T>
+class InputFeed : public InputFeedBase {
+   public:
+    /**
+     * Creates a feed that can hold at least `capacity` pending updates.
+     *
+     * @param capacity - maximum number of updates waiting to be drained.
+     */
+    explicit InputFeed(std::size_t capacity);
+
+    InputFeed(const InputFeed&) = delete;
+
+    InputFeed& operator=(const InputFeed&) = delete;
+
+    /**
+     * Registers an Anchor that can be updated through this feed. This must be
+     * called before the producer thread starts pushing.
+     *
+     * @param anchor - input Anchor.
+     * @return the slot identifying `anchor` in calls to `push()`.
+     */
+    std::size_t addAnchor(const AnchorPtr<T>& anchor);
+
+    /**
+     * Queues a new value for the Anchor registered at `slot`. Must only be
+     * called from the producer thread.
+     *
+     * @param slot - slot returned by `addAnchor()`.
+     * @param value - new value of the Anchor.
+     * @return false if the feed is full, in which case the update is dropped.
+     */
+    bool push(std::size_t slot, const T& value);
+
+   private:
+    // PRIVATE TYPES
+    struct Update {
+        std::size_t d_slot{};
+
+        T d_value{};
+    };
+
+    // PRIVATE MANIPULATORS
+    void drain(Engine& engine) override;
+
+    // PRIVATE ACCESSORS
+    bool hasUpdates() const override;
+
+    // PRIVATE DATA
+    std::vector<Update> d_ring;
+    // Fixed-size ring buffer whose size is a power of two.
+
+    std::size_t d_mask;
+
+    alignas(64) std::atomic<std::size_t> d_head;
+    // Index of the next update to be written. Only the producer writes it.
+
+    alignas(64) std::atomic<std::size_t> d_tail;
+    // Index of the next update to be read. Only the consumer writes it.
+
+    alignas(64) std::vector<AnchorPtr<T>> d_anchors;
+    // Registered Anchors, indexed by slot.
+
+    std::vector<T> d_latestValues;
+    // Latest value drained for each slot.
+
+    std::vector<char> d_isUpdated;
+    // Whether the slot has an update in the current drain.
+
+    std::vector<std::size_t> d_updatedSlots;
+    // Slots updated in the current drain, in the order of their first update.
+};
+
+template <typename T>
+InputFeed<T>::InputFeed(std::size_t capacity)
+    : d_ring(), d_mask(0), d_head(0), d_tail(0) {
+    std::size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    d_ring.resize(size);
+    d_mask = size - 1;
+}
+
+template <typename T>
+std::size_t InputFeed<T>::addAnchor(const AnchorPtr<T>& anchor) {
+    d_anchors.push_back(anchor);
+    d_latestValues.emplace_back();
+    d_isUpdated.push_back(false);
+    d_updatedSlots.reserve(d_anchors.size());
+
+    return d_anchors.size() - 1;
+}
+
+template <typename T>
+bool InputFeed<T>::push(std::size_t slot, const T& value) {
+    const std::size_t head = d_head.load(std::memory_order_relaxed);
+
+    if (head - d_tail.load(std::memory_order_acquire) == d_ring.size()) {
+        return false;
+    }
+
+    Update& update = d_ring[head & d_mask];
+    update.d_slot  = slot;
+    update.d_value = value;
+
+    d_head.store(head + 1, std::memory_order_release);
+
+    wakeEngine();
+    return true;
+}
+
+template <typename T>
+void InputFeed<T>::drain(Engine& engine) {
+    const std::size_t head = d_head.load(std::memory_order_acquire);
+    std::size_t       tail = d_tail.load(std::memory_order_relaxed);
+
+    if (head == tail) {
+        return;
+    }
+
+    for (; tail != head; tail++) {
+        Update& update = d_ring[tail & d_mask];
+
+        std::swap(d_latestValues[update.d_slot], update.d_value);
+        if (!d_isUpdated[update.d_slot]) {
+            d_isUpdated[update.d_slot] = true;
+            d_updatedSlots.push_back(update.d_slot);
+        }
+    }
+
+    // Release the ring before calling the Engine so the producer can resume.
+    d_tail.store(tail, std::memory_order_release);
+
+    for (std::size_t slot : d_updatedSlots) {
+        engine.set(d_anchors[slot], std::move(d_latestValues[slot]));
+        d_isUpdated[slot] = false;
+    }
+
+    d_updatedSlots.clear();
+}
+
+template <typename T>
+bool InputFeed<T>::hasUpdates() const {
+    return d_head.load(std::memory_order_acquire) !=
+           d_tail.load(std::memory_order_relaxed);
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_INPUTFEED_H
@@ -0,0 +1,193 @@
+// memocache.h
+#ifndef ANCHORS_MEMOCACHE_H
+#define ANCHORS_MEMOCACHE_H
+
+#include <boost/container_hash/hash.hpp>
+#include <cstddef>
+#include <limits>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * Options for an Anchor that memoizes its updater function. See
+ * Anchors::map(const AnchorPtr<InputType1>&, const SingleInputUpdater&, const
+ * MemoOptions&).
+ */
+struct MemoOptions {
+    std::size_t maxEntries = 16;
+    // Maximum number of input values whose results are cached.
+
+    std::size_t maxBytes = std::numeric_limits<std::size_t>::max();
+    // Maximum approximate memory used by the cached inputs and results. See
+    // `memoFootprint()`.
+};
+
+/**
+ * Counters describing the cache of a memoized Anchor.
+ */
+struct MemoStats {
+    std::size_t hits = 0;
+    // Number of computations that reused a cached result.
+
+    std::size_t misses = 0;
+    // Number of computations that called the updater function.
+
+    std::size_t evictions = 0;
+    // Number of cached results dropped to stay within the limits.
+
+    std::size_t entries = 0;
+    // Number of results currently cached.
+
+    std::size_t bytes = 0;
+    // Approximate memory used by the cached inputs and results.
+};
+
+/**
+ * Returns the approximate memory used by `value`, which counts towards
+ * `MemoOptions::maxBytes`. Overload this function in namespace `anchors` for
+ * types that own heap memory.
+ */
+template <typename T>
+std::size_t memoFootprint(const T& value) {
+    return sizeof(value);
+}
+
+inline std::size_t memoFootprint(const std::string& value) {
+    return sizeof(value) + value.capacity();
+}
+
+template <typename T>
+std::size_t memoFootprint(const std::vector<T>& value) {
+    return sizeof(value) + value.capacity() * sizeof(T);
+}
+
+template <typename T1, typename T2>
+std::size_t memoFootprint(const std::pair<T1, T2>& value) {
+    return memoFootprint(value.first) + memoFootprint(value.second);
+}
+
+/**
+ * `MemoCacheBase` represents a MemoCache without its type information, which
+ * allows an Anchor to report the statistics of its cache.
+ */
+class MemoCacheBase {
+   public:
+    virtual ~MemoCacheBase(){};
+
+    virtual MemoStats getStats() const = 0;
+};
+
+/**
+ * A bounded cache of the results of an updater function, keyed on its input
+ * values, which evicts the least recently used result first.
+ *
+ * @tparam Key - type of the input values. It must be equality comparable and
+ * hashable with `boost::hash`, which supports standard containers and pairs.
+ * @tparam Value - type of the results.
+ */
+template <typename Key, typename Value>
+class MemoCache : public MemoCacheBase {
+   public:
+    explicit MemoCache(const MemoOptions& options);
+
+    MemoCache(const MemoCache&) = delete;
+
+    MemoCache& operator=(const MemoCache&) = delete;
+
+    /**
+     * Returns the result cached for `key` and marks it as the most recently
+     * used, or null if there is none.
+     */
+    const Value* find(const Key& key);
+
+    /**
+     * Caches `value` as the result for `key`, then evicts the least recently
+     * used results until the cache is within its limits.
+     */
+    void insert(const Key& key, const Value& value);
+
+    MemoStats getStats() const override;
+
+   private:
+    // PRIVATE TYPES
+    struct Entry {
+        Key d_key;
+
+        Value d_value;
+
+        std::size_t d_bytes;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    // PRIVATE DATA
+    MemoOptions d_options;
+
+    EntryList d_entries;
+    // Cached results, from the most to the least recently used.
+
+    std::unordered_map<Key, typename EntryList::iterator, boost::hash<Key>>
+        d_index;
+
+    MemoStats d_stats;
+};
+
+template <typename Key, typename Value>
+MemoCache<Key, Value>::MemoCache(const MemoOptions& options)
+    : d_options(options), d_entries(), d_index(), d_stats() {}
+
+template <typename Key, typename Value>
+const Value* MemoCache<Key, Value>::find(const Key& key) {
+    auto it = d_index.find(key);
+    if (it == d_index.end()) {
+        d_stats.misses++;
+        return nullptr;
+    }
+
+    d_stats.hits++;
+    d_entries.splice(d_entries.begin(), d_entries, it->second);
+
+    return &it->second->d_value;
+}
+
+template <typename Key, typename Value>
+void MemoCache<Key, Value>::insert(const Key& key, const Value& value) {
+    std::size_t bytes = memoFootprint(key) + memoFootprint(value);
+
+    auto it = d_index.find(key);
+    if (it != d_index.end()) {
+        d_stats.bytes -= it->second->d_bytes;
+        d_entries.erase(it->second);
+        d_index.erase(it);
+    }
+
+    d_entries.push_front({key, value, bytes});
+    d_index.emplace(key, d_entries.begin());
+    d_stats.bytes += bytes;
+
+    while (!d_entries.empty() && (d_entries.size() > d_options.maxEntries ||
+                                  d_stats.bytes > d_options.maxBytes)) {
+        Entry& oldest = d_entries.back();
+
+        d_stats.bytes -= oldest.d_bytes;
+        d_stats.evictions++;
+        d_index.erase(oldest.d_key);
+        d_entries.pop_back();
+    }
+
+    d_stats.entries = d_entries.size();
+}
+
+template <typename Key, typename Value>
+MemoStats MemoCache<Key, Value>::getStats() const {
+    return d_stats;
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_MEMOCACHE_H
@@ -0,0 +1,429 @@
+// recorder.h
+#ifndef ANCHORS_RECORDER_H
+#define ANCHORS_RECORDER_H
+
+#include "anchorutil.h"
+#include "engine.h"
+#include "serializer.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * ReplayRegistry maps names to the value types and updater functions that can
+ * appear in a trace written by a Recorder, so that the trace can be replayed
+ * in another process.
+ *
+ * `int`, `long`, `double`, `bool` and `std::string` are registered by default.
+ * Register the updaters of a graph once, for example from a static
+ * initializer in a source file linked into both the application and the
+ * replay tool:
+ *
+ * ````cpp
+ * static const bool registered = [] {
+ *     auto& registry = anchors::ReplayRegistry::instance();
+ *     registry.addMap2<double>("price", [](double& s, double& q) {
+ *         return s * q;
+ *     });
+ *     return true;
+ * }();
+ * ````
+ */
+class ReplayRegistry {
+   public:
+    /**
+     * Returns the registry used by Recorder and Replayer.
+     */
+    static ReplayRegistry& instance();
+
+    ReplayRegistry(const ReplayRegistry&) = delete;
+
+    ReplayRegistry& operator=(const ReplayRegistry&) = delete;
+
+    /**
+     * Registers a value type under the given name.
+     *
+     * @tparam T - value type. `Serializer<T>` must support it.
+     */
+    template <typename T>
+    void addType(const std::string& name);
+
+    /**
+     * Registers an updater function with one input under the given name.
+     * Its input and output types must be registered.
+     */
+    template <typename T, typename InputType1 = T>
+    void addMap(const std::string&                                      name,
+                const typename Anchor<T, InputType1>::SingleInputUpdater& fn);
+
+    /**
+     * Registers an updater function with two inputs under the given name.
+     * Its input and output types must be registered.
+     */
+    template <typename T, typename InputType1 = T, typename InputType2 = T>
+    void addMap2(
+        const std::string&                                            name,
+        const typename Anchor<T, InputType1, InputType2>::DualInputUpdater& fn);
+
+   private:
+    // PRIVATE TYPES
+    using NodePtr = std::shared_ptr<AnchorBase>;
+
+    struct TypeEntry {
+        std::string d_name;
+
+        std::function<NodePtr(const char*&, const char*)> d_create;
+        // Reads a value and creates an Anchor holding it.
+
+        std::function<void(Engine&, const NodePtr&, const char*&, const char*)>
+            d_set;
+        // Reads a value and sets it on an Anchor.
+
+        std::function<void(Engine&, const NodePtr&)> d_get;
+
+        std::function<void(Engine&, const NodePtr&, int)> d_observe;
+
+        std::function<void(Engine&, const NodePtr&)> d_unobserve;
+    };
+
+    struct UpdaterEntry {
+        std::vector<std::type_index> d_inputTypes;
+
+        std::type_index d_outputType;
+
+        std::function<NodePtr(const std::vector<NodePtr>&)> d_build;
+        // Creates an Anchor computed from the given inputs.
+    };
+
+    // CREATORS
+    ReplayRegistry();
+
+    // PRIVATE ACCESSORS
+    const TypeEntry& findType(const std::string& name) const;
+    // Throws `std::invalid_argument` if no type has this name.
+
+    const TypeEntry& findType(std::type_index type) const;
+    // Throws `std::invalid_argument` if the type is not registered.
+
+    const UpdaterEntry& findUpdater(const std::string& name) const;
+    // Throws `std::invalid_argument` if no updater has this name.
+
+    // PRIVATE DATA
+    std::unordered_map<std::string, TypeEntry> d_types;
+
+    std::unordered_map<std::type_index, std::string> d_typeNames;
+
+    std::unordered_map<std::string, UpdaterEntry> d_updaters;
+
+    friend class Recorder;
+
+    friend class Replayer;
+};
+
+/**
+ * Recorder writes a compact binary trace of the construction of a graph and of
+ * the operations performed on it by an Engine, which `Replayer` and the
+ * `anchors_replay` tool play back to reproduce performance problems offline.
+ *
+ * Build the recorded graph with the functions of this class instead of those
+ * of `Anchors`, referring to updaters by the names they were registered with
+ * in the ReplayRegistry, then pass the Recorder to `Engine::setRecorder()` to
+ * record `set()`, `update()`, `get()`, `observe()` and `unobserve()` calls.
+ *
+ * ````cpp
+ * Recorder recorder("session.trace");
+ *
+ * auto spot(recorder.create(100.0));
+ * auto quantity(recorder.create(2.0));
+ * auto value(recorder.map2<double>(spot, quantity, "price"));
+ *
+ * engine.setRecorder(&recorder);
+ * engine.observe(value);
+ * ````
+ *
+ * The Recorder keeps the Anchors it created alive until it is destroyed.
+ */
+class Recorder {
+   public:
+    /**
+     * Creates a Recorder writing to the given file, replacing its contents.
+     *
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    explicit Recorder(const std::filesystem::path& path);
+
+    Recorder(const Recorder&) = delete;
+
+    Recorder& operator=(const Recorder&) = delete;
+
+    /**
+     * Flushes the trace to the file.
+     */
+    ~Recorder();
+
+    /**
+     * Creates an Anchor containing the given value. See Anchors::create()
+     *
+     * @throws std::invalid_argument if `T` is not registered.
+     */
+    template <typename T>
+    AnchorPtr<T> create(const T& value);
+
+    /**
+     * Creates an Anchor from an input Anchor using a registered updater. See
+     * Anchors::map()
+     *
+     * @throws std::invalid_argument if the updater is not registered with
+     * these types, or `anchor` was not created by this Recorder.
+     */
+    template <typename T, typename InputType1 = T>
+    AnchorPtr<T> map(const AnchorPtr<InputType1>& anchor,
+                     const std::string&           updater);
+
+    /**
+     * Creates an Anchor from two input Anchors using a registered updater.
+     * See Anchors::map2()
+     *
+     * @throws std::invalid_argument if the updater is not registered with
+     * these types, or an input was not created by this Recorder.
+     */
+    template <typename T, typename InputType1 = T, typename InputType2 = T>
+    AnchorPtr<T> map2(const AnchorPtr<InputType1>& anchor1,
+                      const AnchorPtr<InputType2>& anchor2,
+                      const std::string&           updater);
+
+    /**
+     * Writes the buffered part of the trace to the file.
+     */
+    void flush();
+
+   private:
+    // PRIVATE TYPES
+    using NodePtr = std::shared_ptr<AnchorBase>;
+
+    enum class Operation : char {
+        CREATE    = 'C',
+        MAP       = 'M',
+        SET       = 'S',
+        GET       = 'G',
+        OBSERVE   = 'O',
+        UNOBSERVE = 'U'
+    };
+
+    // PRIVATE MANIPULATORS
+    NodePtr build(const std::string&                  updater,
+                  const std::vector<NodePtr>&         inputs,
+                  const std::vector<std::type_index>& inputTypes,
+                  std::type_index                     outputType);
+    // Creates an Anchor with a registered updater and records it, after
+    // checking that the updater was registered with the given types.
+
+    void addNode(const NodePtr& node);
+    // Assigns the next index to `node`.
+
+    void recordSet(const AnchorBase& anchor);
+
+    void recordGet(const AnchorBase& anchor);
+
+    void recordObserve(const AnchorBase& anchor, int priority);
+
+    void recordUnobserve(const AnchorBase& anchor);
+
+    void writeIndex(const AnchorBase& anchor);
+    // Appends the index of `anchor` to the trace.
+
+    void writeString(const std::string& value);
+
+    // PRIVATE ACCESSORS
+    std::uint32_t indexOf(const AnchorBase& anchor) const;
+    // Returns the index of `anchor`, or throws `std::invalid_argument` if it
+    // was not created by this Recorder.
+
+    // PRIVATE DATA
+    std::ofstream d_file;
+
+    std::vector<char> d_buffer;
+    // Operations not yet written to the file.
+
+    std::vector<NodePtr> d_nodes;
+    // Recorded Anchors, in order of creation.
+
+    std::unordered_map<const AnchorBase*, std::uint32_t> d_indices;
+    // Index of each recorded Anchor in `d_nodes`.
+
+    friend class Engine;
+
+    friend class Replayer;
+};
+
+/**
+ * Statistics of a replayed trace. Latencies are those of the `get()` calls,
+ * which include the stabilization they trigger.
+ */
+struct ReplayReport {
+    std::size_t numNodes = 0;
+
+    std::size_t numOperations = 0;
+
+    std::size_t numGets = 0;
+
+    std::chrono::nanoseconds total{};
+
+    std::chrono::nanoseconds p50{};
+
+    std::chrono::nanoseconds p90{};
+
+    std::chrono::nanoseconds p99{};
+
+    std::chrono::nanoseconds max{};
+};
+
+/**
+ * Replayer rebuilds the graph recorded in a trace and plays back its
+ * operations, in order, on a new Engine.
+ */
+class Replayer {
+   public:
+    /**
+     * Creates a Replayer for the trace in the given file.
+     */
+    explicit Replayer(const std::filesystem::path& path);
+
+    /**
+     * Replays the trace.
+     *
+     * @throws std::invalid_argument if the trace refers to types or updaters
+     * that are not registered, or is not a valid trace.
+     * @throws std::out_of_range if the trace is truncated.
+     */
+    ReplayReport run();
+
+   private:
+    // PRIVATE DATA
+    std::filesystem::path d_path;
+};
+
+template <typename T>
+void ReplayRegistry::addType(const std::string& name) {
+    static_assert(Serializer<T>::isSupported,
+                  "anchors::ReplayRegistry: type must support Serializer");
+
+    auto typed = [](const NodePtr& node) {
+        return std::dynamic_pointer_cast<AnchorWrap<T>>(node);
+    };
+
+    TypeEntry entry{
+        name,
+        [](const char*& cursor, const char* end) -> NodePtr {
+            return Anchors::create(Serializer<T>::read(cursor, end));
+        },
+        [typed](Engine&        engine,
+                const NodePtr& node,
+                const char*&   cursor,
+                const char*    end) {
+            AnchorPtr<T> anchor(typed(node));
+            engine.set(anchor, Serializer<T>::read(cursor, end));
+        },
+        [typed](Engine& engine, const NodePtr& node) {
+            engine.get(typed(node));
+        },
+        [typed](Engine& engine, const NodePtr& node, int priority) {
+            AnchorPtr<T> anchor(typed(node));
+            engine.observe(anchor, priority);
+        },
+        [typed](Engine& engine, const NodePtr& node) {
+            AnchorPtr<T> anchor(typed(node));
+            engine.unobserve(anchor);
+        }};
+
+    d_typeNames.insert_or_assign(std::type_index(typeid(T)), name);
+    d_types.insert_or_assign(name, std::move(entry));
+}
+
+template <typename T, typename InputType1>
+void ReplayRegistry::addMap(
+    const std::string&                                        name,
+    const typename Anchor<T, InputType1>::SingleInputUpdater& fn) {
+    d_updaters.insert_or_assign(
+        name,
+        UpdaterEntry{{std::type_index(typeid(InputType1))},
+                     std::type_index(typeid(T)),
+                     [fn](const std::vector<NodePtr>& inputs) -> NodePtr {
+                         return Anchors::map<T, InputType1>(
+                             std::dynamic_pointer_cast<AnchorWrap<InputType1>>(
+                                 inputs[0]),
+                             fn);
+                     }});
+}
+
+template <typename T, typename InputType1, typename InputType2>
+void ReplayRegistry::addMap2(
+    const std::string&                                                  name,
+    const typename Anchor<T, InputType1, InputType2>::DualInputUpdater& fn) {
+    d_updaters.insert_or_assign(
+        name,
+        UpdaterEntry{{std::type_index(typeid(InputType1)),
+                      std::type_index(typeid(InputType2))},
+                     std::type_index(typeid(T)),
+                     [fn](const std::vector<NodePtr>& inputs) -> NodePtr {
+                         return Anchors::map2<T, InputType1, InputType2>(
+                             std::dynamic_pointer_cast<AnchorWrap<InputType1>>(
+                                 inputs[0]),
+                             std::dynamic_pointer_cast<AnchorWrap<InputType2>>(
+                                 inputs[1]),
+                             fn);
+                     }});
+}
+
+template <typename T>
+AnchorPtr<T> Recorder::create(const T& value) {
+    const ReplayRegistry::TypeEntry& type =
+        ReplayRegistry::instance().findType(std::type_index(typeid(T)));
+
+    AnchorPtr<T> anchor(Anchors::create(value));
+
+    d_buffer.push_back(static_cast<char>(Operation::CREATE));
+    writeString(type.d_name);
+    Serializer<T>::write(d_buffer, value);
+    addNode(anchor);
+
+    return anchor;
+}
+
+template <typename T, typename InputType1>
+AnchorPtr<T> Recorder::map(const AnchorPtr<InputType1>& anchor,
+                           const std::string&           updater) {
+    return std::dynamic_pointer_cast<AnchorWrap<T>>(
+        build(updater,
+              {anchor},
+              {std::type_index(typeid(InputType1))},
+              std::type_index(typeid(T))));
+}
+
+template <typename T, typename InputType1, typename InputType2>
+AnchorPtr<T> Recorder::map2(const AnchorPtr<InputType1>& anchor1,
+                            const AnchorPtr<InputType2>& anchor2,
+                            const std::string&           updater) {
+    return std::dynamic_pointer_cast<AnchorWrap<T>>(
+        build(updater,
+              {anchor1, anchor2},
+              {std::type_index(typeid(InputType1)),
+               std::type_index(typeid(InputType2))},
+              std::type_index(typeid(T))));
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_RECORDER_H
@@ -0,0 +1,57 @@
+// scratch.h
+#ifndef ANCHORS_SCRATCH_H
+#define ANCHORS_SCRATCH_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+
+namespace anchors {
+
+/**
+ * Returns the scratch memory resource of the Engine that is stabilizing on
+ * the calling thread, or `std::pmr::get_default_resource()` if none is.
+ *
+ * The scratch resource is a monotonic arena that is reset at the end of each
+ * stabilization, even one stopped early by a `StabilizationLimit`, so
+ * allocating from it costs a pointer bump and never calls the global
+ * allocator while the arena has room. Updaters can use it for
+ * temporaries and for the values they return:
+ *
+ * ````cpp
+ * auto name(Anchors::map2<std::pmr::string>(
+ *     first, last, [](std::pmr::string& f, std::pmr::string& l) {
+ *         std::pmr::string result(f, anchors::scratchResource());
+ *         result.append(" ").append(l);
+ *         return result;
+ *     }));
+ * ````
+ *
+ * An Anchor stores its value in memory that outlives the arena: a standard
+ * `std::pmr` container returned by an updater is copied into the storage of
+ * the Anchor's current value, which reuses its capacity. Values that keep the
+ * allocator they were moved from, such as `Immutable`, must not be built in
+ * the arena.
+ */
+std::pmr::memory_resource* scratchResource();
+
+/**
+ * Returns a copy of `value` for use as the input of an updater. Types that use
+ * a polymorphic allocator, such as `std::pmr::string`, are copied into the
+ * scratch resource.
+ */
+template <typename T>
+T copyToScratch(const T& value) {
+    using Allocator = std::pmr::polymorphic_allocator<std::byte>;
+
+    if constexpr (std::uses_allocator_v<T, Allocator>) {
+        return std::make_obj_using_allocator<T>(Allocator(scratchResource()),
+                                                value);
+    } else {
+        return value;
+    }
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_SCRATCH_H
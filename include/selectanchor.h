@@ -0,0 +1,224 @@
+// selectanchor.h
+#ifndef ANCHORS_SELECTANCHOR_H
+#define ANCHORS_SELECTANCHOR_H
+
+#include "anchor.h"
+
+#include <boost/container_hash/hash.hpp>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace anchors {
+
+template <typename K>
+class SelectedAnchor;
+
+/**
+ * An Anchor whose value is the value of a key Anchor, and which tells its
+ * dependants apart by the key they watch. See Anchors::select().
+ *
+ * The Anchors returned by `isSelected()` are indexed by their key in a hash
+ * table, so when the key changes from `a` to `b`, only the Anchors for `a` and
+ * `b`, along with any other dependant of the selector, are recomputed. The
+ * cost of a change is independent of the number of keys watched.
+ *
+ * @tparam K - type of the key. It must be hashable with `boost::hash`.
+ */
+template <typename K>
+class SelectorAnchor
+    : public Anchor<K>,
+      public std::enable_shared_from_this<SelectorAnchor<K>> {
+   public:
+    /**
+     * Creates a SelectorAnchor. See Anchors::select()
+     *
+     * @param key - key Anchor.
+     */
+    explicit SelectorAnchor(const std::shared_ptr<AnchorWrap<K>>& key);
+
+    /**
+     * Returns an Anchor that is true while the key is equal to `key`. Calls
+     * with equal keys return the same Anchor for as long as it exists.
+     *
+     * @param key - key watched by the returned Anchor.
+     */
+    std::shared_ptr<AnchorWrap<bool>> isSelected(const K& key);
+
+   private:
+    // PRIVATE MANIPULATORS
+    void compute(int stabilizationNumber) override;
+    // Reads the key and, if it changed, records the dependants that watch
+    // the old and the new key, along with the other dependants.
+
+    void addDependant(const std::shared_ptr<AnchorBase>& dependant) override;
+
+    void removeDependant(const std::shared_ptr<AnchorBase>& dependant) override;
+
+    void addChangedDependant(const K& key);
+    // Adds the Anchor watching `key` to `d_changedDependants`, if it is a
+    // dependant.
+
+    // PRIVATE ACCESSORS
+    const std::unordered_set<std::shared_ptr<AnchorBase>>&
+    getChangedDependants() const override;
+
+    // PRIVATE DATA
+    std::unordered_map<K, std::weak_ptr<SelectedAnchor<K>>, boost::hash<K>>
+        d_selectedAnchors;
+    // Anchors returned by `isSelected()`, by key.
+
+    std::unordered_set<std::shared_ptr<AnchorBase>> d_otherDependants;
+    // Dependants that are not returned by `isSelected()`, which are affected
+    // by every change of the key.
+
+    std::unordered_set<std::shared_ptr<AnchorBase>> d_changedDependants;
+    // Dependants affected by the last change of the key.
+
+    template <typename>
+    friend class SelectedAnchor;
+};
+
+/**
+ * An Anchor that is true while the key of a SelectorAnchor has a given value.
+ * See SelectorAnchor::isSelected()
+ *
+ * @tparam K - type of the key.
+ */
+template <typename K>
+class SelectedAnchor : public Anchor<bool, K> {
+   public:
+    /**
+     * Creates a SelectedAnchor.
+     *
+     * @param selector - selector whose key is watched.
+     * @param key - value of the key for which the Anchor is true.
+     */
+    SelectedAnchor(const std::shared_ptr<SelectorAnchor<K>>& selector,
+                   const K&                                  key);
+
+   private:
+    // PRIVATE ACCESSORS
+    bool isOutdated() const override;
+    // Returns true if the Anchor is not frozen, and has never been computed or
+    // its value doesn't match the current key of the selector. Unlike other
+    // Anchors, it isn't outdated merely because the key changed.
+
+    // PRIVATE DATA
+    SelectorAnchor<K>* d_selector;
+
+    K d_key;
+
+    template <typename>
+    friend class SelectorAnchor;
+};
+
+template <typename K>
+SelectorAnchor<K>::SelectorAnchor(const std::shared_ptr<AnchorWrap<K>>& key)
+    : Anchor<K>(key, [](K& value) { return value; }),
+      d_selectedAnchors(),
+      d_otherDependants(),
+      d_changedDependants() {}
+
+template <typename K>
+std::shared_ptr<AnchorWrap<bool>> SelectorAnchor<K>::isSelected(const K& key) {
+    std::weak_ptr<SelectedAnchor<K>>& slot = d_selectedAnchors[key];
+    if (auto existing = slot.lock()) {
+        return existing;
+    }
+
+    auto anchor =
+        std::make_shared<SelectedAnchor<K>>(this->shared_from_this(), key);
+    slot = anchor;
+
+    return anchor;
+}
+
+template <typename K>
+void SelectorAnchor<K>::compute(int stabilizationNumber) {
+    if (this->d_recomputeId == stabilizationNumber) {
+        // Don't compute a node more than once in the same cycle
+        return;
+    }
+
+    const bool isFirstComputation = this->d_hasNeverBeenComputed;
+    this->d_recomputeId           = stabilizationNumber;
+    this->d_hasNeverBeenComputed  = false;
+
+    K key = this->d_firstDependency->get();
+    if (!isFirstComputation && key == this->d_value) {
+        return;
+    }
+
+    d_changedDependants = d_otherDependants;
+    addChangedDependant(this->d_value);
+    addChangedDependant(key);
+
+    this->updateValue(std::move(key), stabilizationNumber);
+}
+
+template <typename K>
+void SelectorAnchor<K>::addDependant(
+    const std::shared_ptr<AnchorBase>& dependant) {
+    this->d_dependants.insert(dependant);
+
+    auto* selected = dynamic_cast<SelectedAnchor<K>*>(dependant.get());
+    if (!selected || selected->d_selector != this) {
+        d_otherDependants.insert(dependant);
+    }
+}
+
+template <typename K>
+void SelectorAnchor<K>::removeDependant(
+    const std::shared_ptr<AnchorBase>& dependant) {
+    this->d_dependants.erase(dependant);
+    d_otherDependants.erase(dependant);
+}
+
+template <typename K>
+void SelectorAnchor<K>::addChangedDependant(const K& key) {
+    auto it = d_selectedAnchors.find(key);
+    if (it == d_selectedAnchors.end()) {
+        return;
+    }
+
+    std::shared_ptr<AnchorBase> anchor = it->second.lock();
+    if (!anchor) {
+        d_selectedAnchors.erase(it);
+        return;
+    }
+
+    if (this->d_dependants.contains(anchor)) {
+        d_changedDependants.insert(std::move(anchor));
+    }
+}
+
+template <typename K>
+const std::unordered_set<std::shared_ptr<AnchorBase>>&
+SelectorAnchor<K>::getChangedDependants() const {
+    return d_changedDependants;
+}
+
+template <typename K>
+SelectedAnchor<K>::SelectedAnchor(
+    const std::shared_ptr<SelectorAnchor<K>>& selector,
+    const K&                                  key)
+    : Anchor<bool, K>(selector,
+                      [key](K& current) { return current == key; }),
+      d_selector(selector.get()),
+      d_key(key) {}
+
+template <typename K>
+bool SelectedAnchor<K>::isOutdated() const {
+    if (this->d_isFrozen) {
+        return false;
+    }
+
+    return this->d_hasNeverBeenComputed ||
+           (d_selector->d_value == d_key) != this->d_value;
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_SELECTANCHOR_H
@@ -0,0 +1,146 @@
+// serializer.h
+#ifndef ANCHORS_SERIALIZER_H
+#define ANCHORS_SERIALIZER_H
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * Customization point used to write the value of an Anchor to an Engine
+ * snapshot and read it back. See Engine::saveSnapshot().
+ *
+ * The primary template marks `T` as unsupported: Anchors of such types are
+ * still recorded in a snapshot, but without a value, and are recomputed after
+ * the snapshot is loaded. To support a type, specialize `Serializer` with:
+ *
+ * ````cpp
+ * template <>
+ * struct anchors::Serializer<MyType> {
+ *     static constexpr bool isSupported = true;
+ *
+ *     static void write(std::vector<char>& buffer, const MyType& value);
+ *
+ *     static MyType read(const char*& cursor, const char* end);
+ * };
+ * ````
+ *
+ * `write` appends the encoded value to `buffer`. `read` decodes a value
+ * starting at `cursor`, advances `cursor` past it, and must not read beyond
+ * `end`.
+ *
+ * Specializations are provided for arithmetic and enum types, `std::string`,
+ * and `std::vector` and `std::pair` of supported types.
+ *
+ * @tparam T - type of the value.
+ */
+template <typename T, typename Enable = void>
+struct Serializer {
+    static constexpr bool isSupported = false;
+};
+
+namespace serializer {
+
+inline void writeBytes(std::vector<char>& buffer, const void* data,
+                       std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+inline void readBytes(const char*& cursor, const char* end, void* data,
+                      std::size_t size) {
+    if (static_cast<std::size_t>(end - cursor) < size) {
+        throw std::out_of_range("anchors::Serializer: truncated snapshot");
+    }
+
+    std::memcpy(data, cursor, size);
+    cursor += size;
+}
+
+}  // namespace serializer
+
+template <typename T>
+struct Serializer<
+    T,
+    std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>> {
+    static constexpr bool isSupported = true;
+
+    static void write(std::vector<char>& buffer, const T& value) {
+        serializer::writeBytes(buffer, &value, sizeof(T));
+    }
+
+    static T read(const char*& cursor, const char* end) {
+        T value;
+        serializer::readBytes(cursor, end, &value, sizeof(T));
+        return value;
+    }
+};
+
+template <>
+struct Serializer<std::string> {
+    static constexpr bool isSupported = true;
+
+    static void write(std::vector<char>& buffer, const std::string& value) {
+        Serializer<std::size_t>::write(buffer, value.size());
+        serializer::writeBytes(buffer, value.data(), value.size());
+    }
+
+    static std::string read(const char*& cursor, const char* end) {
+        std::string value(Serializer<std::size_t>::read(cursor, end), '\0');
+        serializer::readBytes(cursor, end, value.data(), value.size());
+        return value;
+    }
+};
+
+template <typename T>
+struct Serializer<std::vector<T>,
+                  std::enable_if_t<Serializer<T>::isSupported>> {
+    static constexpr bool isSupported = true;
+
+    static void write(std::vector<char>& buffer, const std::vector<T>& value) {
+        Serializer<std::size_t>::write(buffer, value.size());
+        for (const auto& element : value) {
+            Serializer<T>::write(buffer, element);
+        }
+    }
+
+    static std::vector<T> read(const char*& cursor, const char* end) {
+        std::size_t    size = Serializer<std::size_t>::read(cursor, end);
+        std::vector<T> value;
+        value.reserve(size);
+
+        for (std::size_t i = 0; i < size; i++) {
+            value.push_back(Serializer<T>::read(cursor, end));
+        }
+
+        return value;
+    }
+};
+
+template <typename T1, typename T2>
+struct Serializer<std::pair<T1, T2>,
+                  std::enable_if_t<Serializer<T1>::isSupported &&
+                                   Serializer<T2>::isSupported>> {
+    static constexpr bool isSupported = true;
+
+    static void write(std::vector<char>&        buffer,
+                      const std::pair<T1, T2>& value) {
+        Serializer<T1>::write(buffer, value.first);
+        Serializer<T2>::write(buffer, value.second);
+    }
+
+    static std::pair<T1, T2> read(const char*& cursor, const char* end) {
+        T1 first = Serializer<T1>::read(cursor, end);
+        return {std::move(first), Serializer<T2>::read(cursor, end)};
+    }
+};
+
+}  // namespace anchors
+
+#endif  // ANCHORS_SERIALIZER_H
@@ -0,0 +1,211 @@
+// shardedengine.h
+#ifndef ANCHORS_SHARDEDENGINE_H
+#define ANCHORS_SHARDEDENGINE_H
+
+#include "anchorutil.h"
+#include "engine.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * ShardedEngine partitions a graph across several Engine shards, each of which
+ * is stabilized on its own dedicated thread.
+ *
+ * Every Anchor belongs to exactly one shard: build and observe each partition
+ * of the graph using the Engine returned by `shard()`, and connect partitions
+ * with `link()`, which creates an input Anchor in the target shard that
+ * receives the value of an Anchor in the source shard.
+ *
+ * `stabilize()` brings all shards up-to-date in waves. Shards with no incoming
+ * links are stabilized first, in parallel; then the values of their linked
+ * Anchors are forwarded, and the shards that depend only on them are
+ * stabilized, and so on. Once it returns, every shard reflects the same set of
+ * inputs, so values read with `get()` form a consistent global view.
+ *
+ * Note that this class is not thread-safe: all its functions, as well as any
+ * use of the shards' Engines, must happen on a single thread.
+ */
+class ShardedEngine {
+   public:
+    /**
+     * Creates a ShardedEngine with the given number of shards and starts one
+     * worker thread per shard.
+     *
+     * @param numShards - number of Engine shards.
+     */
+    explicit ShardedEngine(std::size_t numShards);
+
+    ShardedEngine(const ShardedEngine&) = delete;
+
+    ShardedEngine& operator=(const ShardedEngine&) = delete;
+
+    /**
+     * Stops and joins the worker threads.
+     */
+    ~ShardedEngine();
+
+    /**
+     * Returns the number of shards.
+     */
+    std::size_t numShards() const;
+
+    /**
+     * Returns the Engine of the given shard, which can be used to observe,
+     * unobserve or set the Anchors in that shard. Use `get()` on this class
+     * rather than on the shard's Engine to read a consistent value.
+     *
+     * @param index - index of the shard.
+     * @return the Engine of the shard.
+     */
+    Engine& shard(std::size_t index);
+
+    /**
+     * Connects an Anchor in one shard to a new input Anchor in another. The
+     * source Anchor is observed in its shard and its value is forwarded to
+     * the returned Anchor at every stabilization.
+     *
+     * Links between shards must not form a cycle.
+     *
+     * @tparam T - type of the Anchor value.
+     * @param sourceShard - index of the shard containing `source`.
+     * @param source - Anchor whose value is forwarded.
+     * @param targetShard - index of the shard the returned Anchor belongs to.
+     * @return an input Anchor in the target shard.
+     * @throws std::invalid_argument if the link would create a cycle between
+     * shards.
+     */
+    template <typename T>
+    AnchorPtr<T> link(std::size_t         sourceShard,
+                      const AnchorPtr<T>& source,
+                      std::size_t         targetShard);
+
+    /**
+     * Brings every observed Anchor in every shard up-to-date, stabilizing
+     * independent shards in parallel.
+     */
+    void stabilize();
+
+    /**
+     * Returns the value of an Anchor in the given shard, first stabilizing all
+     * shards if any of them has pending changes.
+     *
+     * @tparam T - type of the Anchor value.
+     * @param index - index of the shard containing `anchor`.
+     * @param anchor - input Anchor.
+     * @return the current value of the input Anchor.
+     */
+    template <typename T>
+    T get(std::size_t index, const AnchorPtr<T>& anchor);
+
+   private:
+    // PRIVATE TYPES
+    struct Shard {
+        Engine d_engine;
+
+        std::thread d_worker;
+
+        int d_level{};
+        // Length of the longest chain of links leading to this shard. Shards
+        // at the same level do not depend on each other.
+    };
+
+    struct Link {
+        std::size_t d_sourceShard;
+
+        std::size_t d_targetShard;
+
+        std::function<void()> d_forward;
+        // Copies the value of the source Anchor into the target Anchor.
+    };
+
+    // PRIVATE MANIPULATORS
+    void run(Shard& shard);
+    // Body of a shard's worker thread: waits for a wave that includes the
+    // shard and stabilizes it.
+
+    void addLink(Link link);
+    // Stores `link` and recomputes the level of every shard.
+
+    // PRIVATE ACCESSORS
+    void validateLink(std::size_t sourceShard, std::size_t targetShard) const;
+    // Throws if a link from `sourceShard` to `targetShard` would create a
+    // cycle between shards.
+
+    bool hasPendingChanges() const;
+    // Returns true if any shard has Anchors waiting to be recomputed.
+
+    bool reaches(std::size_t from, std::size_t to) const;
+    // Returns true if shard `to` depends on shard `from` through links.
+
+    // PRIVATE DATA
+    std::vector<std::unique_ptr<Shard>> d_shards;
+
+    std::vector<Link> d_links;
+
+    int d_maxLevel;
+
+    std::mutex d_mutex;
+
+    std::condition_variable d_waveStarted;
+
+    std::condition_variable d_waveFinished;
+
+    unsigned long d_wave;
+    // Incremented each time the coordinator starts stabilizing a level.
+
+    int d_waveLevel;
+    // Level of the shards that should stabilize in the current wave.
+
+    std::size_t d_pendingShards;
+    // Number of shards in the current wave that have not finished.
+
+    std::exception_ptr d_error;
+    // First exception thrown by a shard in the current wave.
+
+    bool d_stopping;
+};
+
+template <typename T>
+AnchorPtr<T> ShardedEngine::link(std::size_t         sourceShard,
+                                 const AnchorPtr<T>& source,
+                                 std::size_t         targetShard) {
+    validateLink(sourceShard, targetShard);
+
+    Engine& sourceEngine = shard(sourceShard);
+    Engine& targetEngine = shard(targetShard);
+
+    AnchorPtr<T> observedSource(source);
+    sourceEngine.observe(observedSource);
+
+    AnchorPtr<T> target(Anchors::create(sourceEngine.get(observedSource)));
+
+    addLink({sourceShard,
+             targetShard,
+             [&sourceEngine, &targetEngine, observedSource, target]() mutable {
+                 targetEngine.set(target, sourceEngine.get(observedSource));
+             }});
+
+    return target;
+}
+
+template <typename T>
+T ShardedEngine::get(std::size_t index, const AnchorPtr<T>& anchor) {
+    if (hasPendingChanges()) {
+        stabilize();
+    }
+
+    return shard(index).get(anchor);
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_SHARDEDENGINE_H
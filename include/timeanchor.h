@@ -0,0 +1,159 @@
+// timeanchor.h
+#ifndef ANCHORS_TIMEANCHOR_H
+#define ANCHORS_TIMEANCHOR_H
+
+#include "anchor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * Type of the times of the Engine's clock. See `Engine::advanceClock()`.
+ */
+using Time = std::chrono::system_clock::time_point;
+
+/**
+ * `TimeAnchorBase` represents a TimeAnchor without its type information, which
+ * allows the Engine to keep timers for TimeAnchors of different types.
+ */
+class TimeAnchorBase {
+   public:
+    virtual ~TimeAnchorBase(){};
+
+   protected:
+    virtual bool advanceTo(Time now) = 0;
+    // Sets the value of the Anchor at time `now`, which is never earlier than
+    // in the previous call. Returns true if the value changed.
+
+    virtual std::optional<Time> nextChange() const = 0;
+    // Returns the time of the next change of the value after the time of the
+    // last call to `advanceTo()`, or nothing if the value never changes again.
+
+    bool d_isScheduled = false;
+    // Whether the Engine has a timer for the next change of the Anchor.
+
+    friend class Engine;
+};
+
+/**
+ * An input Anchor whose value is a step function of the Engine's clock. The
+ * Engine updates it when its clock passes one of the steps, and throws
+ * `std::logic_error` if it is set. See Anchors::at(), Anchors::after() and
+ * Anchors::stepFunction().
+ *
+ * @tparam T - type of the Anchor's value.
+ */
+template <typename T>
+class TimeAnchor : public Anchor<T>, public TimeAnchorBase {
+   public:
+    /**
+     * Creates a TimeAnchor whose value is `initial` until the clock reaches
+     * the time of the first step, and then the value of the latest step the
+     * clock reached.
+     *
+     * @param initial - value before the first step.
+     * @param steps - times at which the value changes, and the new values.
+     */
+    TimeAnchor(const T& initial, std::vector<std::pair<Time, T>> steps);
+
+    /**
+     * Creates a TimeAnchor whose steps are relative to the time of the clock
+     * when the Anchor is first observed.
+     *
+     * @param initial - value before the first step.
+     * @param steps - delays after which the value changes, and the new values.
+     */
+    TimeAnchor(const T&                                           initial,
+               std::vector<std::pair<std::chrono::nanoseconds, T>> steps);
+
+   private:
+    // PRIVATE MANIPULATORS
+    bool advanceTo(Time now) override;
+
+    // PRIVATE ACCESSORS
+    std::optional<Time> nextChange() const override;
+
+    // PRIVATE DATA
+    std::vector<std::pair<std::chrono::nanoseconds, T>> d_steps;
+    // Steps sorted by time, relative to `d_origin`.
+
+    std::optional<Time> d_origin;
+    // Time the steps are relative to, or nothing until the Anchor is first
+    // observed if they are relative to that time.
+
+    std::size_t d_nextStep;
+    // Index of the first step after the time of the last call to
+    // `advanceTo()`.
+};
+
+template <typename T>
+TimeAnchor<T>::TimeAnchor(const T&                        initial,
+                          std::vector<std::pair<Time, T>> steps)
+    : Anchor<T>(initial), d_steps(), d_origin(Time()), d_nextStep(0) {
+    this->d_isTimeAnchor = true;
+
+    d_steps.reserve(steps.size());
+    for (auto& [time, value] : steps) {
+        d_steps.emplace_back(time.time_since_epoch(), std::move(value));
+    }
+
+    std::stable_sort(d_steps.begin(),
+                     d_steps.end(),
+                     [](const auto& a, const auto& b) {
+                         return a.first < b.first;
+                     });
+}
+
+template <typename T>
+TimeAnchor<T>::TimeAnchor(
+    const T&                                           initial,
+    std::vector<std::pair<std::chrono::nanoseconds, T>> steps)
+    : Anchor<T>(initial), d_steps(std::move(steps)), d_origin(), d_nextStep(0) {
+    this->d_isTimeAnchor = true;
+
+    std::stable_sort(d_steps.begin(),
+                     d_steps.end(),
+                     [](const auto& a, const auto& b) {
+                         return a.first < b.first;
+                     });
+}
+
+template <typename T>
+bool TimeAnchor<T>::advanceTo(Time now) {
+    if (!d_origin) {
+        d_origin = now;
+    }
+
+    const std::size_t previousStep = d_nextStep;
+    while (d_nextStep < d_steps.size() &&
+           *d_origin + d_steps[d_nextStep].first <= now) {
+        d_nextStep++;
+    }
+
+    if (d_nextStep == previousStep ||
+        d_steps[d_nextStep - 1].second == this->d_value) {
+        return false;
+    }
+
+    this->d_value = d_steps[d_nextStep - 1].second;
+    return true;
+}
+
+template <typename T>
+std::optional<Time> TimeAnchor<T>::nextChange() const {
+    if (!d_origin || d_nextStep == d_steps.size()) {
+        return std::nullopt;
+    }
+
+    return *d_origin +
+           std::chrono::ceil<Time::duration>(d_steps[d_nextStep].first);
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_TIMEANCHOR_H
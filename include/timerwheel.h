@@ -0,0 +1,210 @@
+// timerwheel.h
+#ifndef ANCHORS_TIMERWHEEL_H
+#define ANCHORS_TIMERWHEEL_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace anchors {
+
+/**
+ * A hierarchical timer wheel holding values of type `T` that expire at given
+ * ticks.
+ *
+ * Timers are spread over 11 levels of 64 slots. A timer is stored at the level
+ * of the highest 6-bit digit in which its expiry differs from the current
+ * tick, in the slot given by that digit of its expiry. Advancing the wheel
+ * only visits the slots whose range of ticks it passes: the timers found there
+ * either fire or move to a lower level, which happens at most once per level.
+ * The cost of `advance()` is therefore proportional to the number of timers
+ * that expire, not to the number of timers in the wheel or to the number of
+ * ticks elapsed.
+ *
+ * @tparam T - type of the values attached to timers.
+ */
+template <typename T>
+class TimerWheel {
+   public:
+    /**
+     * Creates an empty wheel whose current tick is `now`.
+     */
+    explicit TimerWheel(std::uint64_t now = 0);
+
+    /**
+     * Adds a timer that expires at tick `due`. A timer that is already due
+     * fires on the next call to `advance()`.
+     *
+     * @param due - tick at which the timer expires.
+     * @param value - value passed to the callback of `advance()`.
+     */
+    void insert(std::uint64_t due, T value);
+
+    /**
+     * Moves the current tick forward to `now` and calls `callback` with the
+     * value of each timer that expired, in order of expiry. The callback may
+     * insert new timers. Does nothing if `now` is before the current tick.
+     *
+     * @param now - new current tick.
+     * @param callback - function called with a `T&` for each expired timer.
+     */
+    template <typename Callback>
+    void advance(std::uint64_t now, Callback&& callback);
+
+    /**
+     * Returns the current tick.
+     */
+    std::uint64_t now() const;
+
+    /**
+     * Returns the number of timers waiting to expire.
+     */
+    std::size_t size() const;
+
+   private:
+    // PRIVATE TYPES
+    struct Timer {
+        std::uint64_t d_due;
+
+        T d_value;
+    };
+
+    static constexpr int k_SLOT_BITS  = 6;
+    static constexpr int k_NUM_SLOTS  = 1 << k_SLOT_BITS;
+    static constexpr int k_NUM_LEVELS = (64 + k_SLOT_BITS - 1) / k_SLOT_BITS;
+
+    // PRIVATE MANIPULATORS
+    void place(Timer timer);
+    // Stores `timer` in the slot for its expiry relative to `d_now`.
+
+    // PRIVATE DATA
+    std::array<std::array<std::vector<Timer>, k_NUM_SLOTS>, k_NUM_LEVELS>
+        d_slots;
+
+    std::array<std::uint64_t, k_NUM_LEVELS> d_occupied;
+    // Bitmap of the non-empty slots of each level.
+
+    std::vector<Timer> d_ready;
+    // Timers inserted after they were already due.
+
+    std::vector<Timer> d_expired;
+    // Timers taken out of the wheel by `advance()`, kept between calls to
+    // reuse its memory.
+
+    std::uint64_t d_now;
+
+    std::size_t d_size;
+};
+
+template <typename T>
+TimerWheel<T>::TimerWheel(std::uint64_t now)
+    : d_slots(), d_occupied(), d_ready(), d_expired(), d_now(now), d_size(0) {}
+
+template <typename T>
+void TimerWheel<T>::insert(std::uint64_t due, T value) {
+    d_size++;
+
+    if (due <= d_now) {
+        d_ready.push_back({due, std::move(value)});
+        return;
+    }
+
+    place({due, std::move(value)});
+}
+
+template <typename T>
+void TimerWheel<T>::place(Timer timer) {
+    const int level =
+        (63 - std::countl_zero(timer.d_due ^ d_now)) / k_SLOT_BITS;
+    const int slot =
+        (timer.d_due >> (level * k_SLOT_BITS)) & (k_NUM_SLOTS - 1);
+
+    d_slots[level][slot].push_back(std::move(timer));
+    d_occupied[level] |= std::uint64_t(1) << slot;
+}
+
+template <typename T>
+template <typename Callback>
+void TimerWheel<T>::advance(std::uint64_t now, Callback&& callback) {
+    if (now < d_now) {
+        return;
+    }
+
+    std::swap(d_expired, d_ready);
+
+    // The timers at a level all share the digits of `d_now` above that level
+    // and have a greater digit at that level. If the digits above the level
+    // change, any of them may be due. Otherwise, only those in the slots
+    // between the old and the new digit may be.
+    for (int level = 0; level < k_NUM_LEVELS; level++) {
+        const int shift = level * k_SLOT_BITS;
+        const int above = shift + k_SLOT_BITS;
+
+        const std::uint64_t oldDigit = (d_now >> shift) & (k_NUM_SLOTS - 1);
+        const std::uint64_t newDigit = (now >> shift) & (k_NUM_SLOTS - 1);
+
+        std::uint64_t slots;
+        if (above < 64 && (d_now >> above) != (now >> above)) {
+            slots = ~std::uint64_t(0);
+        } else if (oldDigit == newDigit) {
+            continue;
+        } else {
+            slots = (~std::uint64_t(0) << (oldDigit + 1)) &
+                    (~std::uint64_t(0) >> (63 - newDigit));
+        }
+
+        slots &= d_occupied[level];
+        d_occupied[level] &= ~slots;
+
+        for (; slots; slots &= slots - 1) {
+            auto& timers = d_slots[level][std::countr_zero(slots)];
+
+            std::move(
+                timers.begin(), timers.end(), std::back_inserter(d_expired));
+            timers.clear();
+        }
+    }
+
+    d_now = now;
+
+    // Timers that are not due yet go back to a lower level.
+    auto firstPending = std::partition(
+        d_expired.begin(), d_expired.end(), [now](const Timer& timer) {
+            return timer.d_due <= now;
+        });
+    for (auto it = firstPending; it != d_expired.end(); it++) {
+        place(std::move(*it));
+    }
+    d_expired.erase(firstPending, d_expired.end());
+
+    std::stable_sort(d_expired.begin(),
+                     d_expired.end(),
+                     [](const Timer& a, const Timer& b) {
+                         return a.d_due < b.d_due;
+                     });
+
+    d_size -= d_expired.size();
+    for (auto& timer : d_expired) {
+        callback(timer.d_value);
+    }
+    d_expired.clear();
+}
+
+template <typename T>
+std::uint64_t TimerWheel<T>::now() const {
+    return d_now;
+}
+
+template <typename T>
+std::size_t TimerWheel<T>::size() const {
+    return d_size;
+}
+
+}  // namespace anchors
+
+#endif  // ANCHORS_TIMERWHEEL_H
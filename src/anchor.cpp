@@ -1 +1,38 @@
 #include "../include/anchor.h"
+
+#include <atomic>
+
+namespace anchors {
+
+namespace {
+
+// Number of IDs a thread takes at once.
+constexpr AnchorBase::AnchorId k_ID_RANGE_SIZE = 4096;
+
+// First ID of the next range handed out to a thread.
+std::atomic<AnchorBase::AnchorId> s_nextIdRange(0);
+
+struct IdRange {
+    AnchorBase::AnchorId d_next = 0;
+
+    AnchorBase::AnchorId d_end = 0;
+};
+
+// IDs left in the range of the calling thread.
+thread_local IdRange t_idRange;
+
+}  // namespace
+
+AnchorBase::AnchorId nextAnchorId() {
+    if (t_idRange.d_next == t_idRange.d_end) {
+        t_idRange.d_next =
+            s_nextIdRange.fetch_add(k_ID_RANGE_SIZE, std::memory_order_relaxed);
+        t_idRange.d_end = t_idRange.d_next + k_ID_RANGE_SIZE;
+    }
+
+    return t_idRange.d_next++;
+}
+
+ANCHORS_FOR_EACH_COMMON_TYPE(ANCHORS_INSTANTIATE_ANCHOR, )
+
+}  // namespace anchors
@@ -1 +1,19 @@
 #include "../include/anchorutil.h"
+
+namespace anchors {
+
+AnchorPtr<bool> Anchors::at(Time time) {
+    return stepFunction(false, {{time, true}});
+}
+
+AnchorPtr<bool> Anchors::after(std::chrono::nanoseconds delay) {
+    AnchorPtr<bool> newAnchor(std::make_shared<TimeAnchor<bool>>(
+        false,
+        std::vector<std::pair<std::chrono::nanoseconds, bool>>{{delay, true}}));
+
+    return newAnchor;
+}
+
+ANCHORS_FOR_EACH_COMMON_TYPE(ANCHORS_INSTANTIATE_ANCHORS, )
+
+}  // namespace anchors
@@ -1,75 +1,1351 @@
 #include "../include/engine.h"
 
+#include "../include/inputfeed.h"
+#include "../include/recorder.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <boost/container_hash/hash.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
 namespace anchors {
 
-Engine::Engine()
-    : d_stabilizationNumber(0),
-      d_observedNodes(),
-      d_recomputeHeap(),
-      d_recomputeSet() {}
+namespace {
+
+// Scratch resource of the Engine stabilizing on this thread, if any.
+thread_local std::pmr::memory_resource* t_scratchResource = nullptr;
+
+// Engine whose stabilizer thread is the current thread, if any.
+thread_local const Engine* t_stabilizerEngine = nullptr;
+
+// Returns the tick of the timer wheel for `time`: nanoseconds since the epoch,
+// offset so that earlier times map to smaller unsigned values.
+std::uint64_t toTicks(Time time) {
+    auto nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch())
+            .count();
+
+    return static_cast<std::uint64_t>(nanoseconds) ^
+           (std::uint64_t(1) << 63);
+}
+
+// Makes an Engine's scratch resource the current one for the lifetime of the
+// guard, and resets it when the guard is destroyed.
+class ScratchGuard {
+   public:
+    explicit ScratchGuard(std::pmr::monotonic_buffer_resource* resource)
+        : d_resource(resource), d_previous(t_scratchResource) {
+        t_scratchResource = resource;
+    }
+
+    ScratchGuard(const ScratchGuard&) = delete;
+
+    ScratchGuard& operator=(const ScratchGuard&) = delete;
+
+    ~ScratchGuard() {
+        t_scratchResource = d_previous;
+        d_resource->release();
+    }
+
+   private:
+    std::pmr::monotonic_buffer_resource* d_resource;
+
+    std::pmr::memory_resource* d_previous;
+};
+
+}  // namespace
+
+std::pmr::memory_resource* scratchResource() {
+    return t_scratchResource ? t_scratchResource
+                             : std::pmr::get_default_resource();
+}
+
+Engine::Engine() : Engine(std::pmr::get_default_resource()) {}
+
+Engine::Engine(std::pmr::memory_resource* resource, std::size_t scratchSize)
+    : d_pool(resource),
+      d_scratchBuffer(std::max<std::size_t>(scratchSize, 1), resource),
+      d_scratch(d_scratchBuffer.data(), d_scratchBuffer.size(), resource),
+      d_stabilizationNumber(0),
+      d_observedNodes(&d_pool),
+      d_observationCount(0),
+      d_recomputeHeap(std::greater<std::shared_ptr<AnchorBase>>(),
+                      std::pmr::vector<std::shared_ptr<AnchorBase>>(&d_pool)),
+      d_recomputeSet(&d_pool),
+      d_batch(&d_pool),
+      d_feeds(&d_pool),
+      d_isStabilizing(false),
+      d_recomputeCount(0),
+      d_prioritiesChanged(false),
+      d_latencies(&d_pool),
+      d_recorder(nullptr),
+      d_schedule(),
+      d_now(),
+      d_timers(toTicks(Time())),
+      d_stabilizer(),
+      d_isStabilizerWaiting(false),
+      d_epoch(0),
+      d_scenario() {}
+
+Engine::~Engine() {
+    stopStabilizer();
+
+    for (auto* feed : d_feeds) {
+        feed->d_engine.store(nullptr, std::memory_order_release);
+    }
+}
+
+void Engine::addObserver(const std::shared_ptr<AnchorBase>& anchor,
+                         int                                priority) {
+    addObservers(std::span(&anchor, 1), priority);
+}
+
+void Engine::addObservers(std::span<const std::shared_ptr<AnchorBase>> anchors,
+                          int priority) {
+    d_epoch++;
+
+    // The set keeps its buckets from one Anchor to the next.
+    std::unordered_set<const AnchorBase*> visited;
+
+    for (const auto& anchor : anchors) {
+        auto it = d_observedNodes.find(anchor);
+        if (it != d_observedNodes.end()) {
+            if (it->second.d_priority == priority) {
+                continue;
+            }
+
+            removeObserver(anchor);
+        }
+
+        decompile();
+        d_observedNodes.emplace(anchor,
+                                ObservedNode{d_observationCount++, priority});
 
-void Engine::observeNode(
-    std::shared_ptr<AnchorBase>&                     current,
-    std::unordered_set<std::shared_ptr<AnchorBase>>& visited) {
-    if (visited.contains(current)) {
+        visited.clear();
+        std::shared_ptr<AnchorBase> current = anchor;
+        observeNode(current, visited, priority);
+    }
+
+    if (d_prioritiesChanged) {
+        d_recomputeHeap.reorder();
+        d_prioritiesChanged = false;
+    }
+}
+
+void Engine::removeObserver(const std::shared_ptr<AnchorBase>& anchor) {
+    auto it = d_observedNodes.find(anchor);
+    if (it == d_observedNodes.end()) {
         return;
     }
 
-    visited.insert(current);
-    current->markNecessary();
+    d_epoch++;
+    decompile();
+
+    int priority = it->second.d_priority;
+    d_observedNodes.erase(it);
+
+    std::unordered_set<const AnchorBase*> visited;
+    std::shared_ptr<AnchorBase>           current = anchor;
+    unobserveNode(current, visited, priority);
+
+    if (d_prioritiesChanged) {
+        d_recomputeHeap.reorder();
+        d_prioritiesChanged = false;
+    }
+}
+
+void Engine::observeNode(std::shared_ptr<AnchorBase>&           current,
+                         std::unordered_set<const AnchorBase*>& visited,
+                         int                                    priority) {
+    if (!visited.insert(current.get()).second) {
+        return;
+    }
+
+    int oldPriority = current->getPriority();
+    current->markNecessary(priority);
+    d_prioritiesChanged |= current->getPriority() != oldPriority;
+
+    if (auto* timeAnchor = dynamic_cast<TimeAnchorBase*>(current.get());
+        timeAnchor && !timeAnchor->d_isScheduled && !current->isFrozen()) {
+        scheduleTimer(current, *timeAnchor);
+    }
 
     if (current->isStale() && !d_recomputeSet.contains(current)) {
         d_recomputeHeap.push(current);
+        d_recomputeSet.insert(current);
     }
 
     // Repeat the same for all its dependencies
-    for (auto& dep : current->getDependencies()) {
-        dep->addDependant(current);
-        observeNode(dep, visited);
+    auto dependencies     = current->getDependencies();
+    bool isFrozenByInputs = !dependencies.empty() && !current->isFrozen();
+
+    for (auto& dep : dependencies) {
+        if (!dep->isFrozen()) {
+            dep->addDependant(current);
+        }
+
+        observeNode(dep, visited, priority);
+        isFrozenByInputs &= dep->isFrozen();
+    }
+
+    if (isFrozenByInputs) {
+        if (current->isStale()) {
+            current->compute(++d_stabilizationNumber);
+        }
+
+        freezeNode(current);
     }
 }
 
-void Engine::unobserveNode(std::shared_ptr<AnchorBase>& current) {
-    current->decrementNecessaryCount();
+void Engine::unobserveNode(std::shared_ptr<AnchorBase>&           current,
+                           std::unordered_set<const AnchorBase*>& visited,
+                           int                                    priority) {
+    if (!visited.insert(current.get()).second) {
+        return;
+    }
+
+    int oldPriority = current->getPriority();
+    current->decrementNecessaryCount(priority);
+    d_prioritiesChanged |= current->getPriority() != oldPriority;
 
     for (auto& dep : current->getDependencies()) {
-        unobserveNode(dep);
-        dep->removeDependant(current);
+        unobserveNode(dep, visited, priority);
+
+        if (!current->isNecessary()) {
+            dep->removeDependant(current);
+        }
+    }
+
+    if (!current->isNecessary()) {
+        // Changes of its dependencies are no longer reported to it.
+        current->markDependencyChanged(nullptr);
     }
 }
 
-void Engine::stabilize() {
-    // In the future, we might first need to adjust_heights.
-    if (d_recomputeHeap.empty()) {
+namespace {
+
+// Written at the start of every snapshot file.
+const char SNAPSHOT_MAGIC[8] = {'A', 'N', 'C', 'H', 'S', 'N', 'P', '1'};
+
+struct SnapshotHeader {
+    char          d_magic[8];
+    std::uint64_t d_topologyHash;
+    std::uint64_t d_numNodes;
+    std::int64_t  d_stabilizationNumber;
+};
+
+void visitSnapshotNode(
+    const std::shared_ptr<AnchorBase>&                         current,
+    std::unordered_map<std::shared_ptr<AnchorBase>, std::size_t>& indices,
+    std::vector<std::shared_ptr<AnchorBase>>&                  nodes,
+    std::size_t&                                               topologyHash) {
+    if (indices.contains(current)) {
         return;
     }
 
+    auto dependencies = current->getDependencies();
+    for (auto& dep : dependencies) {
+        visitSnapshotNode(dep, indices, nodes, topologyHash);
+    }
+
+    boost::hash_combine(topologyHash, current->getHeight());
+    boost::hash_combine(topologyHash, dependencies.size());
+    for (auto& dep : dependencies) {
+        boost::hash_combine(topologyHash, indices[dep]);
+    }
+
+    indices[current] = nodes.size();
+    nodes.push_back(current);
+}
+
+}  // namespace
+
+std::vector<std::shared_ptr<AnchorBase>> Engine::snapshotNodes(
+    std::size_t& topologyHash) const {
+    std::vector<std::pair<unsigned long, std::shared_ptr<AnchorBase>>> roots;
+    for (const auto& [anchor, observed] : d_observedNodes) {
+        roots.emplace_back(observed.d_order, anchor);
+    }
+    std::sort(roots.begin(), roots.end());
+
+    std::unordered_map<std::shared_ptr<AnchorBase>, std::size_t> indices;
+    std::vector<std::shared_ptr<AnchorBase>>                     nodes;
+
+    topologyHash = 0;
+    for (auto& root : roots) {
+        visitSnapshotNode(root.second, indices, nodes, topologyHash);
+    }
+
+    return nodes;
+}
+
+void Engine::saveSnapshot(const std::string& path) {
+    stabilize();
+
+    std::size_t topologyHash;
+    auto        nodes = snapshotNodes(topologyHash);
+
+    std::vector<char> buffer(sizeof(SnapshotHeader));
+    for (auto& node : nodes) {
+        node->saveState(buffer);
+    }
+
+    SnapshotHeader header;
+    std::memcpy(header.d_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.d_topologyHash        = topologyHash;
+    header.d_numNodes            = nodes.size();
+    header.d_stabilizationNumber = d_stabilizationNumber;
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    // Size the file before mapping it, since a mapping can't grow the file.
+    std::ofstream(path, std::ios::binary | std::ios::trunc);
+    std::filesystem::resize_file(path, buffer.size());
+
+    boost::interprocess::file_mapping  file(path.c_str(),
+                                           boost::interprocess::read_write);
+    boost::interprocess::mapped_region region(file,
+                                              boost::interprocess::read_write);
+    std::memcpy(region.get_address(), buffer.data(), buffer.size());
+    region.flush();
+}
+
+bool Engine::loadSnapshot(const std::string& path) {
+    if (!std::filesystem::exists(path) ||
+        std::filesystem::file_size(path) < sizeof(SnapshotHeader)) {
+        return false;
+    }
+
+    boost::interprocess::file_mapping  file(path.c_str(),
+                                           boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(file,
+                                              boost::interprocess::read_only);
+
+    const char* cursor = static_cast<const char*>(region.get_address());
+    const char* end    = cursor + region.get_size();
+
+    SnapshotHeader header;
+    std::memcpy(&header, cursor, sizeof(header));
+    cursor += sizeof(header);
+
+    std::size_t topologyHash;
+    auto        nodes = snapshotNodes(topologyHash);
+
+    if (std::memcmp(header.d_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) !=
+            0 ||
+        header.d_topologyHash != topologyHash ||
+        header.d_numNodes != nodes.size()) {
+        return false;
+    }
+
+    // Keep the state of the Anchors loaded so far, so a truncated snapshot
+    // can be undone.
+    std::vector<std::any> originals;
+    originals.reserve(nodes.size());
+    try {
+        for (auto& node : nodes) {
+            originals.push_back(node->copyState());
+            node->loadState(cursor, end);
+        }
+    } catch (...) {
+        for (std::size_t i = 0; i < originals.size(); i++) {
+            nodes[i]->restoreState(originals[i]);
+        }
+        throw;
+    }
+
+    for (auto& node : nodes) {
+        node->markDependencyChanged(nullptr);
+    }
+    d_epoch++;
+
+    d_stabilizationNumber = std::max(
+        d_stabilizationNumber, static_cast<int>(header.d_stabilizationNumber));
+
+    return true;
+}
+
+void Engine::addFeed(InputFeedBase& feed) {
+    auto lock = lockStabilizer();
+    d_feeds.push_back(&feed);
+    feed.d_engine.store(this, std::memory_order_release);
+    if (feed.hasUpdates()) {
+        notifyStabilizer();
+    }
+}
+
+void Engine::removeFeed(InputFeedBase& feed) {
+    auto lock = lockStabilizer();
+    d_feeds.erase(std::remove(d_feeds.begin(), d_feeds.end(), &feed),
+                  d_feeds.end());
+    feed.d_engine.store(nullptr, std::memory_order_release);
+}
+
+void Engine::setRecorder(Recorder* recorder) {
+    if (recorder && d_scenario) {
+        throw std::logic_error(
+            "anchors::Engine: cannot record during a scenario");
+    }
+
+    d_recorder = recorder;
+    d_epoch++;
+}
+
+void Engine::stabilize() { stabilize(StabilizationLimit()); }
+
+bool Engine::stabilizeSteps(std::size_t maxSteps) {
+    StabilizationLimit limit;
+    limit.d_maxSteps = maxSteps;
+
+    return stabilize(limit);
+}
+
+bool Engine::stabilizeFor(std::chrono::nanoseconds budget) {
+    StabilizationLimit limit;
+    limit.d_deadline = std::chrono::steady_clock::now() + budget;
+
+    return stabilize(limit);
+}
+
+Engine::LatencyStats Engine::getLatency(int priority) const {
+    auto it = d_latencies.find(priority);
+
+    return it == d_latencies.end() ? LatencyStats() : it->second;
+}
+
+void Engine::freezeCone(const std::shared_ptr<AnchorBase>& anchor) {
+    if (d_scenario) {
+        throw std::logic_error(
+            "anchors::Engine: cannot freeze during a scenario");
+    }
+
+    d_epoch++;
+    decompile();
+
+    std::vector<std::shared_ptr<AnchorBase>>        cone;
+    std::unordered_set<std::shared_ptr<AnchorBase>> visited;
+    std::vector<std::shared_ptr<AnchorBase>>        pending{anchor};
+
+    while (!pending.empty()) {
+        std::shared_ptr<AnchorBase> current = std::move(pending.back());
+        pending.pop_back();
+
+        if (current->isFrozen() || !visited.insert(current).second) {
+            continue;
+        }
+
+        cone.push_back(current);
+        for (auto& dep : current->getDependencies()) {
+            pending.push_back(dep);
+        }
+    }
+
+    // Inputs have lower heights than the Anchors computed from them.
+    std::sort(cone.begin(), cone.end(), [](const auto& a1, const auto& a2) {
+        return a1->getHeight() < a2->getHeight();
+    });
+
     d_stabilizationNumber++;
-    // Stabilization is a three-step process:
-    // - Remove the node with the smallest height from the recompute heap
-    // - Recompute it.
-    // - If its value changed, add the nodes that depend on it to the heap
+    for (auto& node : cone) {
+        node->markDependencyChanged(nullptr);
+        node->compute(d_stabilizationNumber);
+    }
+
+    for (auto& node : cone) {
+        freezeNode(node);
+    }
+}
+
+Scenario Engine::beginScenario() {
+    auto lock = lockStabilizer();
+    if (d_scenario) {
+        throw std::logic_error(
+            "anchors::Engine: a scenario is already active");
+    }
+
+    if (d_recorder) {
+        // A trace has no way to revert the changes made in the scenario.
+        throw std::logic_error(
+            "anchors::Engine: cannot begin a scenario while recording");
+    }
+
+    d_scenario = std::make_unique<ScenarioState>();
+
+    if (d_schedule) {
+        for (std::size_t word = d_schedule->d_firstDirtyWord;
+             word < d_schedule->d_dirty.size();
+             word++) {
+            for (std::uint64_t bits = d_schedule->d_dirty[word]; bits;
+                 bits &= bits - 1) {
+                d_scenario->d_pending.push_back(
+                    d_schedule->d_nodes[word * 64 + std::countr_zero(bits)]);
+            }
+        }
+    }
+
+    d_scenario->d_pending.insert(d_scenario->d_pending.end(),
+                                 d_recomputeSet.begin(),
+                                 d_recomputeSet.end());
+
+    return Scenario(*this);
+}
+
+void Engine::saveForScenario(const std::shared_ptr<AnchorBase>& node) {
+    if (d_scenario && d_scenario->d_copied.insert(node.get()).second) {
+        d_scenario->d_copies.emplace_back(node, node->copyState());
+    }
+}
+
+void Engine::revertScenario() {
+    auto                           lock     = lockStabilizer();
+    std::unique_ptr<ScenarioState> scenario = std::move(d_scenario);
+    d_epoch++;
+
+    // The recompute queue goes back to what it was when the scenario
+    // started, plus the Anchors that are stale once the copies are restored.
+    // Those are either copied or still waiting: an Anchor that was neither
+    // recomputed nor overwritten during the scenario can only be stale if it
+    // was waiting when the scenario started, or was observed during it.
+    std::vector<std::shared_ptr<AnchorBase>> waiting;
+    if (d_schedule) {
+        for (std::size_t word = d_schedule->d_firstDirtyWord;
+             word < d_schedule->d_dirty.size();
+             word++) {
+            for (std::uint64_t bits = d_schedule->d_dirty[word]; bits;
+                 bits &= bits - 1) {
+                waiting.push_back(
+                    d_schedule->d_nodes[word * 64 + std::countr_zero(bits)]);
+            }
+            d_schedule->d_dirty[word] = 0;
+        }
+        d_schedule->d_firstDirtyWord = d_schedule->d_dirty.size();
+    }
     while (!d_recomputeHeap.empty()) {
-        std::shared_ptr<AnchorBase> top = d_recomputeHeap.top();
+        waiting.push_back(d_recomputeHeap.top());
         d_recomputeHeap.pop();
+    }
+    d_recomputeSet.clear();
+
+    for (auto& [node, state] : scenario->d_copies) {
+        node->restoreState(state);
+        node->markDependencyChanged(nullptr);
+    }
+
+    for (const auto& node : scenario->d_pending) {
+        scheduleNode(node);
+    }
+
+    for (const auto& node : waiting) {
+        if (node->isStale()) {
+            scheduleNode(node);
+        }
+    }
+
+    for (const auto& [node, state] : scenario->d_copies) {
+        if (node->isStale()) {
+            scheduleNode(node);
+        }
+    }
+
+    notifyStabilizer();
+}
+
+void Engine::scheduleNode(const std::shared_ptr<AnchorBase>& node) {
+    if (d_schedule) {
+        auto it = d_schedule->d_indices.find(node.get());
+        if (it != d_schedule->d_indices.end()) {
+            markDirty(it->second);
+            return;
+        }
+
+        decompile();
+    }
+
+    if (!d_recomputeSet.contains(node)) {
+        d_recomputeHeap.push(node);
+        d_recomputeSet.insert(node);
+    }
+}
+
+void Engine::freezeNode(const std::shared_ptr<AnchorBase>& node) {
+    if (node->isFrozen()) {
+        return;
+    }
+
+    node->markFrozen();
+
+    for (auto& dep : node->getDependencies()) {
+        dep->removeDependant(node);
+    }
+
+    // Copy the dependants, since the loop removes them.
+    auto dependants = node->getDependants();
+    for (const auto& dependant : dependants) {
+        node->removeDependant(dependant);
+        dependant->markDependencyChanged(node.get());
+
+        auto dependencies = dependant->getDependencies();
+        bool isFrozenByInputs =
+            std::all_of(dependencies.begin(),
+                        dependencies.end(),
+                        [](const auto& dep) { return dep->isFrozen(); });
+
+        if (isFrozenByInputs) {
+            if (dependant->isStale()) {
+                dependant->compute(d_stabilizationNumber);
+            }
+
+            freezeNode(dependant);
+        } else if (dependant->isStale() &&
+                   !d_recomputeSet.contains(dependant)) {
+            d_recomputeHeap.push(dependant);
+            d_recomputeSet.insert(dependant);
+        }
+    }
+}
+
+void Engine::recordSet(const AnchorBase& anchor) {
+    d_recorder->recordSet(anchor);
+}
+
+void Engine::recordGet(const AnchorBase& anchor) {
+    d_recorder->recordGet(anchor);
+}
+
+void Engine::recordObserve(const AnchorBase& anchor, int priority) {
+    d_recorder->recordObserve(anchor, priority);
+}
+
+void Engine::recordUnobserve(const AnchorBase& anchor) {
+    d_recorder->recordUnobserve(anchor);
+}
+
+void Engine::checkRecorded(const AnchorBase& anchor) const {
+    d_recorder->indexOf(anchor);
+}
+
+void Engine::markInputChanged(const std::shared_ptr<AnchorBase>& anchor) {
+    d_epoch++;
+    d_stabilizationNumber++;
+    anchor->setChangeId(d_stabilizationNumber);
+
+    if (!anchor->isNecessary()) {
+        return;
+    }
+
+    if (d_schedule) {
+        auto it = d_schedule->d_indices.find(anchor.get());
+        if (it != d_schedule->d_indices.end()) {
+            markDependantsDirty(it->second);
+            return;
+        }
+
+        // The Anchor was made necessary by another Engine.
+        decompile();
+    }
+
+    for (const auto& dependant : anchor->getChangedDependants()) {
+        dependant->markDependencyChanged(anchor.get());
+
+        if (dependant->isNecessary() && !d_recomputeSet.contains(dependant)) {
+            d_recomputeHeap.push(dependant);
+            d_recomputeSet.insert(dependant);
+        }
+    }
+}
+
+void Engine::stabilizeThrough(const std::shared_ptr<AnchorBase>& anchor) {
+    if (!hasPendingWork() && d_feeds.empty()) {
+        return;
+    }
+
+    // Anchors are recomputed in decreasing order of priority, then increasing
+    // order of height, and an Anchor's dependencies always come before it.
+    // It is therefore up-to-date once nothing that comes before it is pending.
+    StabilizationLimit limit;
+    limit.d_minPriority = anchor->getPriority();
+    limit.d_maxHeight   = anchor->getHeight();
+
+    const std::size_t recomputeCount = d_recomputeCount;
+
+    auto start = std::chrono::steady_clock::now();
+    stabilize(limit);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (d_recomputeCount == recomputeCount) {
+        return;
+    }
+
+    LatencyStats& stats = d_latencies[d_observedNodes[anchor].d_priority];
+    stats.count++;
+    stats.total += elapsed;
+    stats.max = std::max(stats.max,
+                         std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             elapsed));
+}
 
-        if (!top->isStale()) {
+namespace {
+
+void visitConeNode(const std::shared_ptr<AnchorBase>&         current,
+                   std::unordered_set<const AnchorBase*>&     visited,
+                   std::vector<std::shared_ptr<AnchorBase>>& cone,
+                   std::vector<std::shared_ptr<AnchorBase>>& necessary) {
+    if (!visited.insert(current.get()).second) {
+        return;
+    }
+
+    // The dependencies of necessary Anchors are necessary too.
+    if (current->isNecessary()) {
+        necessary.push_back(current);
+        return;
+    }
+
+    for (auto& dep : current->getDependencies()) {
+        visitConeNode(dep, visited, cone, necessary);
+    }
+
+    cone.push_back(current);
+}
+
+}  // namespace
+
+void Engine::computeCone(const std::shared_ptr<AnchorBase>& anchor) {
+    std::unordered_set<const AnchorBase*>    visited;
+    std::vector<std::shared_ptr<AnchorBase>> cone;
+    std::vector<std::shared_ptr<AnchorBase>> necessary;
+    visitConeNode(anchor, visited, cone, necessary);
+
+    // Stop once the necessary Anchor that is recomputed last is up-to-date.
+    if (!necessary.empty() && (hasPendingWork() || !d_feeds.empty())) {
+        auto last = std::min_element(
+            necessary.begin(),
+            necessary.end(),
+            std::greater<std::shared_ptr<AnchorBase>>());
+
+        StabilizationLimit limit;
+        limit.d_minPriority = (*last)->getPriority();
+        limit.d_maxHeight   = (*last)->getHeight();
+        stabilize(limit);
+    }
+
+    if (cone.empty()) {
+        return;
+    }
+
+    // The cone lists dependencies before their dependants, and none of them is
+    // linked to its dependants, so they are computed in a single pass.
+    d_stabilizationNumber++;
+    for (auto& node : cone) {
+        if (node->isOutdated()) {
+            saveForScenario(node);
+            node->compute(d_stabilizationNumber);
+        }
+    }
+}
+
+bool Engine::refreshObserver(const std::shared_ptr<AnchorBase>& anchor) {
+    if (d_recorder) {
+        recordGet(*anchor);
+    }
+
+    if (d_observedNodes.contains(anchor)) {
+        stabilizeThrough(anchor);
+    }
+
+    // Reads must keep reaching the Engine while it has feeds to drain or
+    // reads to record.
+    return isStabilized() && d_feeds.empty() && !d_recorder;
+}
+
+bool Engine::isStabilized() const {
+    return !d_isStabilizing && !hasPendingWork();
+}
+
+void Engine::advanceClock(Time now) {
+    auto lock = lockStabilizer();
+    if (d_scenario) {
+        throw std::logic_error(
+            "anchors::Engine: cannot advance the clock during a scenario");
+    }
+
+    if (now < d_now) {
+        throw std::invalid_argument(
+            "anchors::Engine: the clock cannot move backwards");
+    }
+
+    const std::uint64_t epoch = d_epoch;
+
+    d_now = now;
+    d_timers.advance(toTicks(now), [this](Timer& timer) {
+        timer.d_timeAnchor->d_isScheduled = false;
+
+        // Timers of Anchors that are no longer needed are dropped. They are
+        // scheduled again when the Anchors are next observed.
+        if (timer.d_anchor->isNecessary() && !timer.d_anchor->isFrozen()) {
+            scheduleTimer(timer.d_anchor, *timer.d_timeAnchor);
+        }
+    });
+
+    if (d_epoch != epoch) {
+        notifyStabilizer();
+    }
+}
+
+Time Engine::now() const { return d_now; }
+
+void Engine::scheduleTimer(const std::shared_ptr<AnchorBase>& anchor,
+                           TimeAnchorBase&                    timeAnchor) {
+    if (timeAnchor.advanceTo(d_now)) {
+        markInputChanged(anchor);
+    }
+
+    if (auto nextChange = timeAnchor.nextChange()) {
+        d_timers.insert(toTicks(*nextChange), Timer{anchor, &timeAnchor});
+        timeAnchor.d_isScheduled = true;
+    }
+}
+
+void Engine::startStabilizer(std::chrono::nanoseconds coalescingDelay) {
+    if (d_stabilizer) {
+        throw std::logic_error(
+            "anchors::Engine: the stabilizer thread already runs");
+    }
+
+    d_stabilizer                    = std::make_unique<Stabilizer>();
+    d_stabilizer->d_coalescingDelay = coalescingDelay;
+    if (hasPendingWork()) {
+        d_stabilizer->d_changeNumber++;
+    }
+
+    d_stabilizer->d_thread = std::thread([this]() { runStabilizer(); });
+}
+
+void Engine::stopStabilizer() {
+    if (!d_stabilizer) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(d_stabilizer->d_mutex);
+        d_stabilizer->d_stopping = true;
+    }
+    d_stabilizer->d_changed.notify_one();
+    d_stabilizer->d_stabilized.notify_all();
+
+    d_stabilizer->d_thread.join();
+    d_stabilizer.reset();
+}
+
+std::uint64_t Engine::changeNumber() const {
+    if (!d_stabilizer) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(d_stabilizer->d_mutex);
+    if (hasFeedUpdates()) {
+        // The next stabilization drains the updates pushed so far.
+        d_stabilizer->d_changeNumber++;
+        d_stabilizer->d_changed.notify_one();
+    }
+
+    return d_stabilizer->d_changeNumber;
+}
+
+void Engine::runStabilizer() {
+    Stabilizer& stabilizer = *d_stabilizer;
+    t_stabilizerEngine     = this;
+
+    std::unique_lock<std::mutex> lock(stabilizer.d_mutex);
+    while (true) {
+        stabilizer.d_changed.wait(lock, [this, &stabilizer]() {
+            if (stabilizer.d_stopping ||
+                stabilizer.d_changeNumber != stabilizer.d_stabilizedNumber) {
+                return true;
+            }
+
+            // Pairs with the fence in `wakeStabilizer()`: either a feed's
+            // update is seen here, or its producer sees this thread waiting.
+            d_isStabilizerWaiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return hasFeedUpdates();
+        });
+        d_isStabilizerWaiting.store(false, std::memory_order_relaxed);
+
+        if (stabilizer.d_coalescingDelay.count() > 0) {
+            // Changes made while waiting join this stabilization.
+            stabilizer.d_changed.wait_for(
+                lock, stabilizer.d_coalescingDelay, [&stabilizer]() {
+                    return stabilizer.d_stopping;
+                });
+        }
+
+        if (stabilizer.d_stopping) {
+            return;
+        }
+
+        const std::uint64_t changeNumber = stabilizer.d_changeNumber;
+        try {
+            stabilize();
+        } catch (...) {
+            if (!stabilizer.d_error) {
+                stabilizer.d_error = std::current_exception();
+            }
+        }
+
+        stabilizer.d_stabilizedNumber = changeNumber;
+        stabilizer.d_stabilized.notify_all();
+    }
+}
+
+std::unique_lock<std::mutex> Engine::lockStabilizer() {
+    if (!d_stabilizer || t_stabilizerEngine == this) {
+        return std::unique_lock<std::mutex>();
+    }
+
+    return std::unique_lock<std::mutex>(d_stabilizer->d_mutex);
+}
+
+std::unique_lock<std::mutex> Engine::waitForStabilizer(
+    std::uint64_t changeNumber) {
+    std::unique_lock<std::mutex> lock = lockStabilizer();
+    if (!lock.owns_lock()) {
+        return lock;
+    }
+
+    Stabilizer& stabilizer = *d_stabilizer;
+    stabilizer.d_stabilized.wait(lock, [&stabilizer, changeNumber]() {
+        return stabilizer.d_stopping ||
+               stabilizer.d_stabilizedNumber >= changeNumber;
+    });
+
+    if (stabilizer.d_error) {
+        std::rethrow_exception(std::exchange(stabilizer.d_error, nullptr));
+    }
+
+    return lock;
+}
+
+void Engine::notifyStabilizer() {
+    if (d_stabilizer && t_stabilizerEngine != this) {
+        d_stabilizer->d_changeNumber++;
+        d_stabilizer->d_changed.notify_one();
+    }
+}
+
+void Engine::wakeStabilizer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!d_isStabilizerWaiting.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    // The lock is free once the stabilizer thread blocks, so the notification
+    // can't be lost between its check of the feeds and its wait.
+    auto lock = lockStabilizer();
+    if (d_stabilizer) {
+        d_stabilizer->d_changed.notify_one();
+    }
+}
+
+bool Engine::isCompiled() const { return d_schedule != nullptr; }
+
+void Engine::compile() {
+    decompile();
+
+    auto schedule = std::make_unique<Schedule>();
+
+    // Collect the Anchors that observed Anchors depend on. Frozen Anchors
+    // never change, so they are left out.
+    std::unordered_set<std::shared_ptr<AnchorBase>> visited;
+    std::vector<std::shared_ptr<AnchorBase>>        pending;
+    for (const auto& [anchor, observedNode] : d_observedNodes) {
+        pending.push_back(anchor);
+    }
+
+    while (!pending.empty()) {
+        std::shared_ptr<AnchorBase> node = std::move(pending.back());
+        pending.pop_back();
+
+        if (node->isFrozen() || !visited.insert(node).second) {
             continue;
         }
 
-        top->compute(d_stabilizationNumber);
+        schedule->d_nodes.push_back(node);
+        for (auto& dependency : node->getDependencies()) {
+            pending.push_back(std::move(dependency));
+        }
+    }
 
-        if (top->getChangeId() == d_stabilizationNumber) {
-            // Its value changed.
-            for (const auto& dependant : top->getDependants()) {
-                if (!d_recomputeSet.contains(dependant)) {
-                    d_recomputeHeap.push(dependant);
-                }
+    std::stable_sort(schedule->d_nodes.begin(),
+                     schedule->d_nodes.end(),
+                     [](const auto& a, const auto& b) {
+                         return std::greater<std::shared_ptr<AnchorBase>>()(b,
+                                                                            a);
+                     });
+
+    const std::size_t numNodes = schedule->d_nodes.size();
+    for (std::size_t i = 0; i < numNodes; i++) {
+        schedule->d_indices.emplace(schedule->d_nodes[i].get(),
+                                    static_cast<std::uint32_t>(i));
+    }
+
+    schedule->d_dependantOffsets.reserve(numNodes + 1);
+    schedule->d_isKeyed.reserve(numNodes);
+    for (const auto& node : schedule->d_nodes) {
+        schedule->d_dependantOffsets.push_back(
+            static_cast<std::uint32_t>(schedule->d_dependants.size()));
+
+        // Anchors that report a subset of their dependants as changed, like
+        // selectors, are marked so that only that subset is scheduled.
+        schedule->d_isKeyed.push_back(&node->getChangedDependants() !=
+                                      &node->getDependants());
+
+        for (const auto& dependant : node->getDependants()) {
+            auto it = schedule->d_indices.find(dependant.get());
+            if (it != schedule->d_indices.end()) {
+                schedule->d_dependants.push_back(it->second);
+            }
+        }
+    }
+    schedule->d_dependantOffsets.push_back(
+        static_cast<std::uint32_t>(schedule->d_dependants.size()));
+
+    schedule->d_dirty.assign((numNodes + 63) / 64, 0);
+    schedule->d_firstDirtyWord = schedule->d_dirty.size();
+    schedule->d_batch.reserve(numNodes);
+
+    // Anchors already waiting are carried over to the schedule. Those that
+    // were unobserved or frozen since they were scheduled aren't part of it,
+    // and the recompute heap would have skipped them as well.
+    while (!d_recomputeHeap.empty()) {
+        auto it = schedule->d_indices.find(d_recomputeHeap.top().get());
+        if (it != schedule->d_indices.end()) {
+            const std::size_t word = it->second / 64;
+
+            schedule->d_dirty[word] |= std::uint64_t(1) << (it->second % 64);
+            schedule->d_firstDirtyWord =
+                std::min(schedule->d_firstDirtyWord, word);
+        }
+        d_recomputeHeap.pop();
+    }
+    d_recomputeSet.clear();
+
+    d_schedule = std::move(schedule);
+}
+
+void Engine::decompile() {
+    if (!d_schedule) {
+        return;
+    }
+
+    for (std::size_t word = d_schedule->d_firstDirtyWord;
+         word < d_schedule->d_dirty.size();
+         word++) {
+        for (std::uint64_t bits = d_schedule->d_dirty[word]; bits;
+             bits &= bits - 1) {
+            const auto& node =
+                d_schedule->d_nodes[word * 64 + std::countr_zero(bits)];
+
+            d_recomputeHeap.push(node);
+            d_recomputeSet.insert(node);
+        }
+    }
+
+    d_schedule.reset();
+}
+
+void Engine::markDirty(std::uint32_t index) {
+    const std::size_t word = index / 64;
+
+    d_schedule->d_dirty[word] |= std::uint64_t(1) << (index % 64);
+    d_schedule->d_firstDirtyWord =
+        std::min(d_schedule->d_firstDirtyWord, word);
+}
+
+void Engine::markDependantsDirty(std::uint32_t index) {
+    const AnchorBase* node = d_schedule->d_nodes[index].get();
+
+    if (d_schedule->d_isKeyed[index]) {
+        const auto& indices = d_schedule->d_indices;
+
+        for (const auto& dependant : node->getChangedDependants()) {
+            dependant->markDependencyChanged(node);
+
+            auto it = indices.find(dependant.get());
+            if (it != indices.end()) {
+                markDirty(it->second);
             }
         }
+        return;
+    }
+
+    const std::uint32_t* dependants = d_schedule->d_dependants.data();
+
+    for (std::uint32_t i = d_schedule->d_dependantOffsets[index];
+         i != d_schedule->d_dependantOffsets[index + 1];
+         i++) {
+        d_schedule->d_nodes[dependants[i]]->markDependencyChanged(node);
+        markDirty(dependants[i]);
     }
+}
 
+bool Engine::hasPendingWork() const { return nextPending() != nullptr; }
+
+const std::shared_ptr<AnchorBase>* Engine::nextPending() const {
+    if (!d_schedule) {
+        return d_recomputeHeap.empty() ? nullptr : &d_recomputeHeap.top();
+    }
+
+    for (std::size_t word = d_schedule->d_firstDirtyWord;
+         word < d_schedule->d_dirty.size();
+         word++) {
+        if (std::uint64_t bits = d_schedule->d_dirty[word]) {
+            return &d_schedule->d_nodes[word * 64 + std::countr_zero(bits)];
+        }
+    }
+
+    return nullptr;
+}
+
+bool Engine::hasFeedUpdates() const {
+    return std::any_of(d_feeds.begin(), d_feeds.end(), [](auto* feed) {
+        return feed->hasUpdates();
+    });
+}
+
+bool Engine::stabilize(const StabilizationLimit& limit) {
+    for (auto* feed : d_feeds) {
+        feed->drain(*this);
+    }
+
+    // In the future, we might first need to adjust_heights.
+    if (!hasPendingWork()) {
+        d_isStabilizing = false;
+        return true;
+    }
+
+    if (!d_isStabilizing) {
+        // A stabilization stopped by `limit` resumes with the same number.
+        d_stabilizationNumber++;
+        d_isStabilizing = true;
+    }
+
+    bool isFinished;
+    {
+        // Updaters don't keep scratch memory beyond `compute()`, so the arena
+        // is reset even when `limit` stops the stabilization early.
+        ScratchGuard scratchGuard(&d_scratch);
+        isFinished =
+            d_schedule ? stabilizeSchedule(limit) : stabilizeHeap(limit);
+    }
+    if (!isFinished) {
+        return false;
+    }
+
+    d_batch.clear();
     d_recomputeSet.clear();
+    d_isStabilizing = false;
+
+    return true;
 }
 
+bool Engine::stabilizeHeap(const StabilizationLimit& limit) {
+    // Stabilization processes the recompute heap one height at a time, starting
+    // with the highest priority:
+    // - Remove all the stale nodes with the highest priority and smallest
+    //   height from the heap.
+    // - Start computing each of them, so that asynchronous updaters run
+    //   concurrently, then wait for and store their results.
+    // - If a node's value changed, add the nodes that depend on it to the heap.
+    //   These always have a greater height and a priority that is not higher,
+    //   so they are never part of the current batch.
+    // The heap is left as it is whenever `limit` is reached, so a later call
+    // resumes where this one stopped.
+    std::size_t steps       = 0;
+    const bool  hasDeadline = limit.hasDeadline();
+
+    while (!d_recomputeHeap.empty()) {
+        const int priority = d_recomputeHeap.top()->getPriority();
+        const int height   = d_recomputeHeap.top()->getHeight();
+
+        if (priority < limit.d_minPriority ||
+            (priority == limit.d_minPriority && height > limit.d_maxHeight) ||
+            steps >= limit.d_maxSteps ||
+            (hasDeadline &&
+             std::chrono::steady_clock::now() >= limit.d_deadline)) {
+            return false;
+        }
+
+        d_batch.clear();
+        while (!d_recomputeHeap.empty() &&
+               d_recomputeHeap.top()->getPriority() == priority &&
+               d_recomputeHeap.top()->getHeight() == height &&
+               steps + d_batch.size() < limit.d_maxSteps) {
+            std::shared_ptr<AnchorBase> top = d_recomputeHeap.top();
+            d_recomputeHeap.pop();
+            d_recomputeSet.erase(top);
+
+            if (top->isStale()) {
+                d_batch.push_back(top);
+            }
+        }
+
+        std::size_t numComputed = 0;
+        try {
+            for (auto& node : d_batch) {
+                node->startCompute(d_stabilizationNumber);
+            }
+
+            for (auto& node : d_batch) {
+                saveForScenario(node);
+                node->compute(d_stabilizationNumber);
+                numComputed++;
+                steps++;
+                d_recomputeCount++;
+
+                if (node->getChangeId() == d_stabilizationNumber) {
+                    // Its value changed.
+                    for (const auto& dependant :
+                         node->getChangedDependants()) {
+                        dependant->markDependencyChanged(node.get());
+
+                        if (!d_recomputeSet.contains(dependant)) {
+                            d_recomputeHeap.push(dependant);
+                            d_recomputeSet.insert(dependant);
+                        }
+                    }
+                }
+            }
+        } catch (...) {
+            // The Anchors of the batch that weren't computed, including the
+            // one whose updater threw, go back to the heap so they aren't left
+            // stale, and the work started for them is dropped.
+            for (std::size_t i = numComputed; i < d_batch.size(); i++) {
+                d_batch[i]->cancelCompute();
+                if (!d_recomputeSet.contains(d_batch[i])) {
+                    d_recomputeHeap.push(d_batch[i]);
+                    d_recomputeSet.insert(d_batch[i]);
+                }
+            }
+            throw;
+        }
+    }
+
+    return true;
+}
+
+bool Engine::stabilizeSchedule(const StabilizationLimit& limit) {
+    // The schedule lists Anchors in the order of the recompute heap, so this
+    // follows the same steps as `stabilizeHeap()`, taking the Anchors with the
+    // same priority and height from consecutive set bits. Dependants always
+    // come later in the schedule, so the scan only moves forward.
+    Schedule&                                 schedule = *d_schedule;
+    std::vector<std::uint64_t>&               dirty    = schedule.d_dirty;
+    std::vector<std::shared_ptr<AnchorBase>>& nodes    = schedule.d_nodes;
+    std::size_t                               steps    = 0;
+
+    const bool hasDeadline = limit.hasDeadline();
+
+    auto nextDirty = [&](std::size_t from) {
+        for (std::size_t word = from / 64; word < dirty.size(); word++) {
+            std::uint64_t bits = dirty[word];
+            if (word == from / 64) {
+                bits &= ~std::uint64_t(0) << (from % 64);
+            }
+
+            if (bits) {
+                return word * 64 + std::countr_zero(bits);
+            }
+        }
+
+        return nodes.size();
+    };
+
+    std::size_t index = nextDirty(schedule.d_firstDirtyWord * 64);
+    while (index < nodes.size()) {
+        schedule.d_firstDirtyWord = index / 64;
+
+        const int priority = nodes[index]->getPriority();
+        const int height   = nodes[index]->getHeight();
+
+        if (priority < limit.d_minPriority ||
+            (priority == limit.d_minPriority && height > limit.d_maxHeight) ||
+            steps >= limit.d_maxSteps ||
+            (hasDeadline &&
+             std::chrono::steady_clock::now() >= limit.d_deadline)) {
+            return false;
+        }
+
+        schedule.d_batch.clear();
+        while (index < nodes.size() &&
+               nodes[index]->getPriority() == priority &&
+               nodes[index]->getHeight() == height &&
+               steps + schedule.d_batch.size() < limit.d_maxSteps) {
+            dirty[index / 64] &= ~(std::uint64_t(1) << (index % 64));
+
+            if (nodes[index]->isStale()) {
+                schedule.d_batch.push_back(static_cast<std::uint32_t>(index));
+            }
+
+            index = nextDirty(index + 1);
+        }
+
+        std::size_t numComputed = 0;
+        try {
+            for (std::uint32_t i : schedule.d_batch) {
+                nodes[i]->startCompute(d_stabilizationNumber);
+            }
+
+            for (std::uint32_t i : schedule.d_batch) {
+                saveForScenario(nodes[i]);
+                nodes[i]->compute(d_stabilizationNumber);
+                numComputed++;
+                steps++;
+                d_recomputeCount++;
+
+                if (nodes[i]->getChangeId() == d_stabilizationNumber) {
+                    // Its value changed.
+                    markDependantsDirty(i);
+                }
+            }
+        } catch (...) {
+            // See `stabilizeHeap()`.
+            for (std::size_t k = numComputed; k < schedule.d_batch.size();
+                 k++) {
+                nodes[schedule.d_batch[k]]->cancelCompute();
+                markDirty(schedule.d_batch[k]);
+            }
+            throw;
+        }
+
+        index = nextDirty(schedule.d_firstDirtyWord * 64);
+    }
+
+    schedule.d_firstDirtyWord = dirty.size();
+    return true;
+}
+
+Scenario::Scenario(Engine& engine) : d_engine(&engine) {}
+
+Scenario::Scenario(Scenario&& other) noexcept
+    : d_engine(std::exchange(other.d_engine, nullptr)) {}
+
+Scenario::~Scenario() { revert(); }
+
+void Scenario::revert() {
+    if (d_engine) {
+        std::exchange(d_engine, nullptr)->revertScenario();
+    }
+}
+
+bool Scenario::isActive() const { return d_engine != nullptr; }
+
+ANCHORS_FOR_EACH_COMMON_TYPE(ANCHORS_INSTANTIATE_ENGINE, )
+
 }  // namespace anchors
@@ -0,0 +1,299 @@
+#include "../include/recorder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace anchors {
+
+namespace {
+
+// Written at the start of every trace file.
+const char TRACE_MAGIC[8] = {'A', 'N', 'C', 'H', 'T', 'R', 'C', '1'};
+
+// Size above which the buffered operations are written to the file.
+const std::size_t FLUSH_THRESHOLD = 1 << 16;
+
+std::chrono::nanoseconds percentile(
+    const std::vector<std::chrono::nanoseconds>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    auto index = static_cast<std::size_t>(fraction * (sorted.size() - 1));
+    return sorted[index];
+}
+
+}  // namespace
+
+ReplayRegistry::ReplayRegistry() : d_types(), d_typeNames(), d_updaters() {
+    addType<int>("int");
+    addType<long>("long");
+    addType<double>("double");
+    addType<bool>("bool");
+    addType<std::string>("string");
+}
+
+ReplayRegistry& ReplayRegistry::instance() {
+    static ReplayRegistry registry;
+    return registry;
+}
+
+const ReplayRegistry::TypeEntry& ReplayRegistry::findType(
+    const std::string& name) const {
+    auto it = d_types.find(name);
+    if (it == d_types.end()) {
+        throw std::invalid_argument("anchors::ReplayRegistry: unknown type " +
+                                    name);
+    }
+
+    return it->second;
+}
+
+const ReplayRegistry::TypeEntry& ReplayRegistry::findType(
+    std::type_index type) const {
+    auto it = d_typeNames.find(type);
+    if (it == d_typeNames.end()) {
+        throw std::invalid_argument(
+            "anchors::ReplayRegistry: unregistered type " +
+            std::string(type.name()));
+    }
+
+    return findType(it->second);
+}
+
+const ReplayRegistry::UpdaterEntry& ReplayRegistry::findUpdater(
+    const std::string& name) const {
+    auto it = d_updaters.find(name);
+    if (it == d_updaters.end()) {
+        throw std::invalid_argument(
+            "anchors::ReplayRegistry: unknown updater " + name);
+    }
+
+    return it->second;
+}
+
+Recorder::Recorder(const std::filesystem::path& path)
+    : d_file(path, std::ios::binary | std::ios::trunc),
+      d_buffer(),
+      d_nodes(),
+      d_indices() {
+    if (!d_file) {
+        throw std::runtime_error("anchors::Recorder: cannot open " +
+                                 path.string());
+    }
+
+    serializer::writeBytes(d_buffer, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+}
+
+Recorder::~Recorder() { flush(); }
+
+void Recorder::flush() {
+    d_file.write(d_buffer.data(),
+                 static_cast<std::streamsize>(d_buffer.size()));
+    d_file.flush();
+    d_buffer.clear();
+}
+
+Recorder::NodePtr Recorder::build(
+    const std::string&                  updater,
+    const std::vector<NodePtr>&         inputs,
+    const std::vector<std::type_index>& inputTypes,
+    std::type_index                     outputType) {
+    const ReplayRegistry& registry = ReplayRegistry::instance();
+    const ReplayRegistry::UpdaterEntry& entry = registry.findUpdater(updater);
+
+    if (entry.d_inputTypes != inputTypes || entry.d_outputType != outputType) {
+        throw std::invalid_argument(
+            "anchors::Recorder: updater " + updater +
+            " was registered with different types");
+    }
+
+    // The output must be replayable, so its type must be registered too.
+    registry.findType(outputType);
+
+    d_buffer.push_back(static_cast<char>(Operation::MAP));
+    writeString(updater);
+    Serializer<std::uint32_t>::write(
+        d_buffer, static_cast<std::uint32_t>(inputs.size()));
+    for (const auto& input : inputs) {
+        writeIndex(*input);
+    }
+
+    NodePtr node = entry.d_build(inputs);
+    addNode(node);
+
+    return node;
+}
+
+void Recorder::addNode(const NodePtr& node) {
+    d_indices.emplace(node.get(), static_cast<std::uint32_t>(d_nodes.size()));
+    d_nodes.push_back(node);
+
+    if (d_buffer.size() >= FLUSH_THRESHOLD) {
+        flush();
+    }
+}
+
+void Recorder::recordSet(const AnchorBase& anchor) {
+    d_buffer.push_back(static_cast<char>(Operation::SET));
+    writeIndex(anchor);
+    anchor.saveValue(d_buffer);
+
+    if (d_buffer.size() >= FLUSH_THRESHOLD) {
+        flush();
+    }
+}
+
+void Recorder::recordGet(const AnchorBase& anchor) {
+    d_buffer.push_back(static_cast<char>(Operation::GET));
+    writeIndex(anchor);
+
+    if (d_buffer.size() >= FLUSH_THRESHOLD) {
+        flush();
+    }
+}
+
+void Recorder::recordObserve(const AnchorBase& anchor, int priority) {
+    d_buffer.push_back(static_cast<char>(Operation::OBSERVE));
+    writeIndex(anchor);
+    Serializer<int>::write(d_buffer, priority);
+}
+
+void Recorder::recordUnobserve(const AnchorBase& anchor) {
+    d_buffer.push_back(static_cast<char>(Operation::UNOBSERVE));
+    writeIndex(anchor);
+}
+
+void Recorder::writeIndex(const AnchorBase& anchor) {
+    Serializer<std::uint32_t>::write(d_buffer, indexOf(anchor));
+}
+
+void Recorder::writeString(const std::string& value) {
+    Serializer<std::string>::write(d_buffer, value);
+}
+
+std::uint32_t Recorder::indexOf(const AnchorBase& anchor) const {
+    auto it = d_indices.find(&anchor);
+    if (it == d_indices.end()) {
+        throw std::invalid_argument(
+            "anchors::Recorder: Anchor was not created by this Recorder");
+    }
+
+    return it->second;
+}
+
+Replayer::Replayer(const std::filesystem::path& path) : d_path(path) {}
+
+ReplayReport Replayer::run() {
+    using Operation = Recorder::Operation;
+    using NodePtr   = std::shared_ptr<AnchorBase>;
+
+    std::ifstream file(d_path, std::ios::binary);
+    if (!file) {
+        throw std::invalid_argument("anchors::Replayer: cannot open " +
+                                    d_path.string());
+    }
+
+    const std::vector<char> trace((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+    const char* cursor = trace.data();
+    const char* end    = trace.data() + trace.size();
+
+    char magic[sizeof(TRACE_MAGIC)];
+    serializer::readBytes(cursor, end, magic, sizeof(magic));
+    if (std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        throw std::invalid_argument("anchors::Replayer: not a trace file");
+    }
+
+    const ReplayRegistry& registry = ReplayRegistry::instance();
+
+    Engine                                        engine;
+    std::vector<NodePtr>                          nodes;
+    std::vector<const ReplayRegistry::TypeEntry*> types;
+    std::vector<std::chrono::nanoseconds>         latencies;
+    ReplayReport                                  report;
+
+    auto readNode = [&]() -> std::size_t {
+        std::uint32_t index = Serializer<std::uint32_t>::read(cursor, end);
+        if (index >= nodes.size()) {
+            throw std::invalid_argument("anchors::Replayer: unknown Anchor");
+        }
+
+        return index;
+    };
+
+    while (cursor != end) {
+        auto operation = static_cast<Operation>(*cursor++);
+        report.numOperations++;
+
+        switch (operation) {
+            case Operation::CREATE: {
+                const auto& type = registry.findType(
+                    Serializer<std::string>::read(cursor, end));
+
+                nodes.push_back(type.d_create(cursor, end));
+                types.push_back(&type);
+                break;
+            }
+            case Operation::MAP: {
+                const auto& updater = registry.findUpdater(
+                    Serializer<std::string>::read(cursor, end));
+
+                std::vector<NodePtr> inputs(
+                    Serializer<std::uint32_t>::read(cursor, end));
+                for (auto& input : inputs) {
+                    input = nodes[readNode()];
+                }
+
+                nodes.push_back(updater.d_build(inputs));
+                types.push_back(&registry.findType(updater.d_outputType));
+                break;
+            }
+            case Operation::SET: {
+                std::size_t index = readNode();
+                types[index]->d_set(engine, nodes[index], cursor, end);
+                break;
+            }
+            case Operation::GET: {
+                std::size_t index = readNode();
+
+                auto start = std::chrono::steady_clock::now();
+                types[index]->d_get(engine, nodes[index]);
+                latencies.push_back(std::chrono::steady_clock::now() - start);
+                break;
+            }
+            case Operation::OBSERVE: {
+                std::size_t index    = readNode();
+                int         priority = Serializer<int>::read(cursor, end);
+                types[index]->d_observe(engine, nodes[index], priority);
+                break;
+            }
+            case Operation::UNOBSERVE: {
+                std::size_t index = readNode();
+                types[index]->d_unobserve(engine, nodes[index]);
+                break;
+            }
+            default:
+                throw std::invalid_argument(
+                    "anchors::Replayer: unknown operation");
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    report.numNodes = nodes.size();
+    report.numGets  = latencies.size();
+    for (auto latency : latencies) {
+        report.total += latency;
+    }
+    report.p50 = percentile(latencies, 0.5);
+    report.p90 = percentile(latencies, 0.9);
+    report.p99 = percentile(latencies, 0.99);
+    report.max = latencies.empty() ? report.max : latencies.back();
+
+    return report;
+}
+
+}  // namespace anchors
@@ -0,0 +1,198 @@
+#include "../include/shardedengine.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <utility>
+
+namespace anchors {
+
+ShardedEngine::ShardedEngine(std::size_t numShards)
+    : d_shards(),
+      d_links(),
+      d_maxLevel(0),
+      d_wave(0),
+      d_waveLevel(0),
+      d_pendingShards(0),
+      d_error(),
+      d_stopping(false) {
+    for (std::size_t i = 0; i < numShards; i++) {
+        d_shards.push_back(std::make_unique<Shard>());
+    }
+
+    for (auto& shard : d_shards) {
+        Shard& current   = *shard;
+        current.d_worker = std::thread([this, &current]() { run(current); });
+    }
+}
+
+ShardedEngine::~ShardedEngine() {
+    {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        d_stopping = true;
+    }
+    d_waveStarted.notify_all();
+
+    for (auto& shard : d_shards) {
+        shard->d_worker.join();
+    }
+}
+
+std::size_t ShardedEngine::numShards() const { return d_shards.size(); }
+
+Engine& ShardedEngine::shard(std::size_t index) {
+    if (index >= d_shards.size()) {
+        throw std::out_of_range("ShardedEngine: invalid shard index");
+    }
+
+    return d_shards[index]->d_engine;
+}
+
+void ShardedEngine::stabilize() {
+    for (int level = 0; level <= d_maxLevel; level++) {
+        {
+            std::unique_lock<std::mutex> lock(d_mutex);
+
+            d_pendingShards = 0;
+            for (auto& shard : d_shards) {
+                if (shard->d_level == level) {
+                    d_pendingShards++;
+                }
+            }
+
+            d_waveLevel = level;
+            d_wave++;
+            d_waveStarted.notify_all();
+
+            d_waveFinished.wait(lock,
+                                [this]() { return d_pendingShards == 0; });
+
+            if (d_error) {
+                std::rethrow_exception(std::exchange(d_error, nullptr));
+            }
+        }
+
+        // Forward the values produced at this level to the shards that
+        // depend on them, before those shards are stabilized.
+        for (auto& link : d_links) {
+            if (d_shards[link.d_sourceShard]->d_level == level) {
+                link.d_forward();
+            }
+        }
+    }
+}
+
+void ShardedEngine::run(Shard& shard) {
+    unsigned long lastWave = 0;
+
+    std::unique_lock<std::mutex> lock(d_mutex);
+    while (true) {
+        d_waveStarted.wait(lock, [this, lastWave]() {
+            return d_stopping || d_wave != lastWave;
+        });
+
+        if (d_stopping) {
+            return;
+        }
+
+        lastWave = d_wave;
+        if (shard.d_level != d_waveLevel) {
+            continue;
+        }
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            shard.d_engine.stabilize();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error && !d_error) {
+            d_error = error;
+        }
+
+        if (--d_pendingShards == 0) {
+            d_waveFinished.notify_one();
+        }
+    }
+}
+
+void ShardedEngine::addLink(Link link) {
+    d_links.push_back(std::move(link));
+
+    // The links form a DAG, so the longest path to every shard is found after
+    // at most `numShards` rounds of relaxation.
+    for (auto& shard : d_shards) {
+        shard->d_level = 0;
+    }
+
+    bool updated = true;
+    while (updated) {
+        updated = false;
+        for (auto& current : d_links) {
+            int candidate = d_shards[current.d_sourceShard]->d_level + 1;
+            if (d_shards[current.d_targetShard]->d_level < candidate) {
+                d_shards[current.d_targetShard]->d_level = candidate;
+                updated                                  = true;
+            }
+        }
+    }
+
+    d_maxLevel = 0;
+    for (auto& shard : d_shards) {
+        d_maxLevel = std::max(d_maxLevel, shard->d_level);
+    }
+}
+
+void ShardedEngine::validateLink(std::size_t sourceShard,
+                                 std::size_t targetShard) const {
+    if (sourceShard >= d_shards.size() || targetShard >= d_shards.size()) {
+        throw std::out_of_range("ShardedEngine: invalid shard index");
+    }
+
+    if (sourceShard == targetShard || reaches(targetShard, sourceShard)) {
+        throw std::invalid_argument(
+            "ShardedEngine: links between shards must not form a cycle");
+    }
+}
+
+bool ShardedEngine::hasPendingChanges() const {
+    for (auto& shard : d_shards) {
+        if (shard->d_engine.hasPendingWork()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ShardedEngine::reaches(std::size_t from, std::size_t to) const {
+    std::vector<bool>       visited(d_shards.size(), false);
+    std::deque<std::size_t> queue{from};
+
+    while (!queue.empty()) {
+        std::size_t current = queue.front();
+        queue.pop_front();
+
+        if (current == to) {
+            return true;
+        }
+
+        if (visited[current]) {
+            continue;
+        }
+        visited[current] = true;
+
+        for (auto& link : d_links) {
+            if (link.d_sourceShard == current) {
+                queue.push_back(link.d_targetShard);
+            }
+        }
+    }
+
+    return false;
+}
+
+}  // namespace anchors
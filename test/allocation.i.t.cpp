@@ -0,0 +1,118 @@
+#include "../include/anchorutil.h"
+#include "../include/engine.h"
+#include "../include/scratch.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <memory_resource>
+#include <new>
+#include <string>
+
+namespace {
+
+std::atomic<bool>        g_countAllocations{false};
+std::atomic<std::size_t> g_numAllocations{0};
+
+}  // namespace
+
+// The default memory resource uses the aligned overloads.
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (g_countAllocations) {
+        ++g_numAllocations;
+    }
+
+    std::size_t align = static_cast<std::size_t>(alignment);
+    if (void* ptr = std::aligned_alloc(align, (size + align - 1) / align *
+                                                  align)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) {
+    return operator new(size, std::align_val_t(alignof(std::max_align_t)));
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+using namespace anchors;
+
+namespace anchorstest {
+
+TEST(AllocationTest, SteadyStateStabilizationDoesNotAllocate) {
+    using String = std::pmr::string;
+
+    Engine engine;
+
+    auto first(Anchors::create(String(100, 'a')));
+    auto last(Anchors::create(String(100, 'b')));
+
+    auto name(Anchors::map2<String>(first, last, [](String& f, String& l) {
+        String result(f, scratchResource());
+        result.append(" ").append(l);
+        return result;
+    }));
+
+    engine.observe(name);
+
+    for (char c = 'c'; c <= 'z'; c++) {
+        String firstValue(100, c);
+        String lastValue(100, c);
+
+        g_numAllocations    = 0;
+        g_countAllocations  = true;
+        engine.set(first, std::move(firstValue));
+        engine.set(last, std::move(lastValue));
+        engine.stabilizeSteps(SIZE_MAX);
+        g_countAllocations = false;
+
+        // The first changes grow the Engine's containers.
+        if (c > 'e') {
+            EXPECT_EQ(g_numAllocations, 0);
+        }
+        EXPECT_EQ(engine.get(name), String(100, c) + " " + String(100, c));
+    }
+}
+
+TEST(AllocationTest, ScratchIsResetWhileLowPriorityWorkIsDeferred) {
+    using String = std::pmr::string;
+
+    Engine engine(std::pmr::get_default_resource(), 1024);
+
+    auto input(Anchors::create(0));
+
+    auto urgent(Anchors::map<int>(input, [](int i) {
+        String temporary(800, 'a', scratchResource());
+        return i + static_cast<int>(temporary.size());
+    }));
+    auto deferred(Anchors::map<int>(input, [](int i) { return i * 2; }));
+
+    engine.observe(urgent, 1);
+    engine.observe(deferred);
+
+    for (int i = 1; i <= 20; i++) {
+        g_numAllocations   = 0;
+        g_countAllocations = true;
+        engine.set(input, i);
+        const int value    = engine.get(urgent);
+        g_countAllocations = false;
+
+        // The first changes grow the Engine's containers.
+        if (i > 3) {
+            EXPECT_EQ(g_numAllocations, 0);
+        }
+        EXPECT_EQ(value, i + 800);
+        EXPECT_FALSE(engine.isStabilized());
+    }
+}
+
+}  // namespace anchorstest
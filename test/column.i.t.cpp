@@ -0,0 +1,76 @@
+#include "../include/columnanchor.h"
+
+#include "../include/anchorutil.h"
+#include "../include/engine.h"
+
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace anchors;
+
+namespace anchorstest {
+
+TEST(Columns, Fma_recomputesOnlyTheChangedBlock) {
+    Engine engine;
+
+    const std::size_t size = 10 * Column<double>::k_BLOCK_SIZE + 5;
+
+    auto spot(Anchors::create(Column<double>(size, 100.0)));
+    auto quantity(Anchors::create(Column<double>(size, 2.0)));
+    auto fees(Anchors::create(Column<double>(size, 0.5)));
+
+    auto value(Columns::fma(spot, quantity, fees));
+    auto first(Columns::lane(value, 0));
+    auto last(Columns::lane(value, size - 1));
+
+    int  lastCounter = 0;
+    auto lastTimesTwo(Anchors::map<double>(last, [&lastCounter](double v) {
+        lastCounter++;
+        return v * 2;
+    }));
+
+    engine.observe(value);
+    engine.observe(first);
+    engine.observe(lastTimesTwo);
+
+    EXPECT_EQ(engine.get(first), 200.5);
+    EXPECT_EQ(engine.get(lastTimesTwo), 401.0);
+
+    Column<double> before = engine.get(value);
+
+    engine.update(spot, [](Column<double>& c) { c.setLane(0, 101.0); });
+    EXPECT_EQ(engine.get(first), 202.5);
+    EXPECT_EQ(engine.get(lastTimesTwo), 401.0);
+    EXPECT_EQ(lastCounter, 1);
+
+    Column<double> after = engine.get(value);
+    EXPECT_NE(after.blockVersion(0), before.blockVersion(0));
+    for (std::size_t b = 1; b < after.numBlocks(); b++) {
+        EXPECT_EQ(after.blockVersion(b), before.blockVersion(b));
+    }
+
+    // The copy held by `before` still has the old values.
+    EXPECT_EQ(before[0], 200.5);
+    EXPECT_EQ(after[size - 1], 200.5);
+}
+
+TEST(Columns, Select_picksLanesByMask) {
+    Engine engine;
+
+    auto mask(Anchors::create(Column<int>(std::vector<int>{1, 0, 1, 0})));
+    auto a(Anchors::create(Column<int>(std::vector<int>{1, 2, 3, 4})));
+    auto b(Anchors::create(Column<int>(std::vector<int>{10, 20, 30, 40})));
+
+    auto sum(Columns::add(Columns::select(mask, a, b), Columns::mul(a, b)));
+
+    engine.observe(sum);
+    EXPECT_EQ(engine.get(sum),
+              Column<int>(std::vector<int>{11, 60, 93, 200}));
+
+    engine.set(b, Column<int>(std::vector<int>{10, 20}));
+    EXPECT_THROW(engine.get(sum), std::invalid_argument);
+}
+
+}  // namespace anchorstest
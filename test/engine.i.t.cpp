@@ -5,10 +5,20 @@
 #include "../include/engine.h"
 
 #include "../include/anchorutil.h"
+#include "../include/immutable.h"
+#include "../include/inputfeed.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <filesystem>
+#include <numeric>
+#include <future>
 #include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 using namespace anchors;
@@ -247,4 +257,1114 @@ TEST_F(EngineFixture, QuadraticFormula) {
     }
 }
 
+TEST_F(EngineFixture, MapAsync_anchorsAtTheSameHeightRunConcurrently) {
+    auto price(Anchors::create(10));
+
+    // Each updater waits for the other to start, which only succeeds if the
+    // engine launches both before waiting on either of them.
+    std::atomic<int> started{0};
+    std::atomic<int> overlapped{0};
+
+    auto waitForOtherLookup = [&started, &overlapped]() {
+        started++;
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (started < 2 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+
+        if (started >= 2) {
+            overlapped++;
+        }
+    };
+
+    auto slowLookup = [&waitForOtherLookup](int multiplier) {
+        return [&waitForOtherLookup, multiplier](int value) {
+            return std::async(std::launch::async,
+                              [&waitForOtherLookup, multiplier, value]() {
+                                  waitForOtherLookup();
+                                  return value * multiplier;
+                              });
+        };
+    };
+
+    auto doubled(Anchors::mapAsync<int>(price, slowLookup(2)));
+    auto tripled(Anchors::mapAsync<int>(price, slowLookup(3)));
+
+    auto total(Anchors::map2<int>(
+        doubled, tripled, [](int a, int b) { return a + b; }));
+
+    d_engine.observe(total);
+
+    EXPECT_EQ(d_engine.get(total), 50);
+    EXPECT_EQ(overlapped, 2);
+
+    started    = 0;
+    overlapped = 0;
+    d_engine.set(price, 20);
+
+    EXPECT_EQ(d_engine.get(total), 100);
+    EXPECT_EQ(overlapped, 2);
+}
+
+TEST_F(EngineFixture, MapAsync2_dependsOnSynchronousAnchors) {
+    auto a(Anchors::create(2));
+    auto b(Anchors::create(3));
+
+    int  callCounter = 0;
+    auto product(Anchors::mapAsync2<int>(a, b, [&callCounter](int x, int y) {
+        callCounter++;
+        std::promise<int> result;
+        result.set_value(x * y);
+        return result.get_future();
+    }));
+
+    auto plusOne(Anchors::map<int>(product, [](int x) { return x + 1; }));
+
+    d_engine.observe(plusOne);
+
+    EXPECT_EQ(d_engine.get(plusOne), 7);
+
+    d_engine.set(b, 5);
+    EXPECT_EQ(d_engine.get(plusOne), 11);
+    EXPECT_EQ(callCounter, 2);
+}
+
+TEST_F(EngineFixture, Stabilize_keepsTheBatchScheduledWhenAnUpdaterThrows) {
+    auto a(Anchors::create(1));
+
+    std::vector<AnchorPtr<int>> syncs;
+    std::vector<AnchorPtr<int>> asyncs;
+    for (int i = 1; i <= 10; i++) {
+        syncs.push_back(Anchors::map<int>(a, [i](int x) { return x * i; }));
+        asyncs.push_back(Anchors::mapAsync<int>(a, [i](int x) {
+            return std::async(std::launch::deferred,
+                              [i, x]() { return x * i; });
+        }));
+    }
+    d_engine.observe(syncs);
+    d_engine.observe(asyncs);
+
+    auto checked(Anchors::map<int>(a, [](int x) {
+        if (x < 0) {
+            throw std::invalid_argument("negative");
+        }
+        return x;
+    }));
+    d_engine.observe(checked);
+    EXPECT_EQ(d_engine.get(checked), 1);
+
+    d_engine.set(a, -1);
+    EXPECT_THROW(d_engine.get(checked), std::invalid_argument);
+
+    // The work started for the Anchors of the batch that weren't computed is
+    // dropped, so it isn't used once the input changes again.
+    for (auto& anchor : asyncs) {
+        d_engine.unobserve(anchor);
+    }
+
+    // The synchronous ones are still scheduled.
+    for (int i = 1; i <= 10; i++) {
+        EXPECT_EQ(d_engine.get(syncs[i - 1]), -i);
+    }
+
+    d_engine.set(a, 4);
+    for (int i = 1; i <= 10; i++) {
+        EXPECT_EQ(d_engine.peek(asyncs[i - 1]), 4 * i);
+    }
+}
+
+TEST(Snapshot, LoadSnapshot_recomputesOnlyChangedInputs) {
+    auto path =
+        (std::filesystem::temp_directory_path() / "anchors_snapshot_test.bin")
+            .string();
+
+    int  sumCounter     = 0;
+    int  productCounter = 0;
+    auto buildGraph     = [&sumCounter, &productCounter]() {
+        auto a(Anchors::create(1));
+        auto b(Anchors::create(2));
+        auto c(Anchors::create(std::string("total")));
+
+        auto sum(Anchors::map2<int>(a, b, [&sumCounter](int x, int y) {
+            sumCounter++;
+            return x + y;
+        }));
+        auto product(
+            Anchors::map2<int>(a, sum, [&productCounter](int x, int y) {
+                productCounter++;
+                return x * y;
+            }));
+        auto label(Anchors::map2<std::string, std::string, int>(
+            c, product, [](const std::string& s, int p) {
+                return s + "=" + std::to_string(p);
+            }));
+
+        return std::make_tuple(a, b, product, label);
+    };
+
+    {
+        Engine engine;
+        auto [a, b, product, label] = buildGraph();
+        engine.observe(label);
+        engine.set(a, 3);
+
+        EXPECT_EQ(engine.get(label), "total=15");
+        engine.saveSnapshot(path);
+    }
+
+    sumCounter     = 0;
+    productCounter = 0;
+
+    Engine engine;
+    auto [a, b, product, label] = buildGraph();
+    engine.observe(label);
+
+    EXPECT_TRUE(engine.loadSnapshot(path));
+    EXPECT_EQ(engine.get(label), "total=15");
+    EXPECT_EQ(sumCounter, 0);
+    EXPECT_EQ(productCounter, 0);
+
+    engine.set(b, 7);
+    EXPECT_EQ(engine.get(label), "total=30");
+    EXPECT_EQ(sumCounter, 1);
+    EXPECT_EQ(productCounter, 1);
+
+    std::filesystem::remove(path);
+}
+
+TEST(Snapshot, LoadSnapshot_rejectsDifferentTopology) {
+    auto path =
+        (std::filesystem::temp_directory_path() / "anchors_snapshot_test2.bin")
+            .string();
+
+    {
+        Engine engine;
+        auto   a(Anchors::create(1));
+        auto   b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+        engine.observe(b);
+        engine.saveSnapshot(path);
+    }
+
+    Engine engine;
+    auto   a(Anchors::create(1));
+    auto   b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+    auto   c(Anchors::map2<int>(a, b, [](int x, int y) { return x * y; }));
+    engine.observe(c);
+
+    EXPECT_FALSE(engine.loadSnapshot(path));
+    EXPECT_EQ(engine.get(c), 2);
+
+    std::filesystem::remove(path);
+}
+
+TEST(Snapshot, LoadSnapshot_leavesAnchorsUnchangedWhenTruncated) {
+    auto path =
+        (std::filesystem::temp_directory_path() / "anchors_snapshot_test3.bin")
+            .string();
+
+    {
+        Engine engine;
+        auto   a(Anchors::create(5));
+        auto   b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+        engine.observe(b);
+        engine.saveSnapshot(path);
+    }
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+
+    Engine engine;
+    auto   a(Anchors::create(1));
+    auto   b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+    engine.observe(b);
+    EXPECT_EQ(engine.get(b), 2);
+
+    EXPECT_THROW(engine.loadSnapshot(path), std::out_of_range);
+    EXPECT_EQ(engine.get(a), 1);
+    EXPECT_EQ(engine.get(b), 2);
+
+    engine.set(a, 3);
+    EXPECT_EQ(engine.get(b), 4);
+
+    std::filesystem::remove(path);
+}
+
+TEST_F(EngineFixture, InputFeed_onlyTheLatestUpdateIsApplied) {
+    auto bid(Anchors::create(100));
+    auto ask(Anchors::create(101));
+
+    int  spreadCounter = 0;
+    auto spread(Anchors::map2<int>(bid, ask, [&spreadCounter](int b, int a) {
+        spreadCounter++;
+        return a - b;
+    }));
+
+    InputFeed<int> feed(4);
+    auto           bidSlot = feed.addAnchor(bid);
+    auto           askSlot = feed.addAnchor(ask);
+    d_engine.addFeed(feed);
+
+    d_engine.observe(spread);
+    EXPECT_EQ(d_engine.get(spread), 1);
+
+    EXPECT_TRUE(feed.push(bidSlot, 102));
+    EXPECT_TRUE(feed.push(bidSlot, 103));
+    EXPECT_TRUE(feed.push(askSlot, 107));
+    EXPECT_TRUE(feed.push(bidSlot, 104));
+    EXPECT_FALSE(feed.push(bidSlot, 105));
+
+    EXPECT_EQ(d_engine.get(spread), 3);
+    EXPECT_EQ(spreadCounter, 2);
+}
+
+TEST_F(EngineFixture, InputFeed_drainsUpdatesFromAnotherThread) {
+    auto price(Anchors::create(0));
+    auto doubled(Anchors::map<int>(price, [](int p) { return p * 2; }));
+
+    InputFeed<int> feed(64);
+    auto           slot = feed.addAnchor(price);
+    d_engine.addFeed(feed);
+    d_engine.observe(doubled);
+
+    const int   numUpdates = 100000;
+    std::thread producer([&feed, slot]() {
+        for (int i = 1; i <= numUpdates; i++) {
+            while (!feed.push(slot, i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    while (d_engine.get(doubled) != numUpdates * 2) {
+        std::this_thread::yield();
+    }
+
+    producer.join();
+    d_engine.removeFeed(feed);
+}
+
+TEST_F(EngineFixture, StabilizeSteps_resumesWhereItStopped) {
+    auto input(Anchors::create(1));
+
+    int  counter = 0;
+    auto addOne  = [&counter](int x) {
+        counter++;
+        return x + 1;
+    };
+
+    auto first(Anchors::map<int>(input, addOne));
+    auto second(Anchors::map<int>(first, addOne));
+    auto third(Anchors::map<int>(second, addOne));
+    auto other(Anchors::map<int>(input, addOne));
+
+    d_engine.observe(third);
+    d_engine.observe(other);
+
+    EXPECT_FALSE(d_engine.isUpToDate(third));
+    // Recomputes `input`, `first` and `other`.
+    EXPECT_FALSE(d_engine.stabilizeSteps(3));
+    EXPECT_FALSE(d_engine.isStabilized());
+    EXPECT_EQ(counter, 2);
+
+    EXPECT_FALSE(d_engine.stabilizeSteps(1));
+    EXPECT_EQ(counter, 3);
+
+    EXPECT_TRUE(d_engine.stabilizeSteps(10));
+    EXPECT_TRUE(d_engine.isStabilized());
+    EXPECT_TRUE(d_engine.isUpToDate(third));
+    EXPECT_EQ(counter, 4);
+    EXPECT_EQ(d_engine.get(third), 4);
+}
+
+TEST_F(EngineFixture, Get_finishesOnlyTheNeededHeightsOfAPartialStabilization) {
+    auto input(Anchors::create(1));
+
+    int  counter = 0;
+    auto addOne  = [&counter](int x) {
+        counter++;
+        return x + 1;
+    };
+
+    auto first(Anchors::map<int>(input, addOne));
+    auto second(Anchors::map<int>(first, addOne));
+    auto third(Anchors::map<int>(second, addOne));
+
+    d_engine.observe(first);
+    d_engine.observe(third);
+    EXPECT_EQ(d_engine.get(third), 4);
+
+    d_engine.set(input, 10);
+    EXPECT_FALSE(d_engine.stabilizeSteps(0));
+
+    EXPECT_EQ(d_engine.get(first), 11);
+    EXPECT_EQ(counter, 4);
+    EXPECT_TRUE(d_engine.isUpToDate(first));
+    EXPECT_FALSE(d_engine.isUpToDate(third));
+
+    EXPECT_TRUE(d_engine.stabilizeFor(std::chrono::seconds(10)));
+    EXPECT_EQ(d_engine.get(third), 13);
+    EXPECT_EQ(counter, 6);
+}
+
+TEST_F(EngineFixture, ObservePriority_higherPriorityConesAreRecomputedFirst) {
+    auto spot(Anchors::create(100));
+
+    int  routingCounter = 0;
+    auto routingPrice(Anchors::map<int>(spot, [&routingCounter](int s) {
+        routingCounter++;
+        return s + 1;
+    }));
+
+    int  reportCounter = 0;
+    auto reportValue(Anchors::map<int>(spot, [&reportCounter](int s) {
+        reportCounter++;
+        return s * 10;
+    }));
+    auto report(Anchors::map<int>(reportValue, [](int v) { return v + 5; }));
+
+    d_engine.observe(routingPrice, 10);
+    d_engine.observe(report);
+
+    EXPECT_EQ(d_engine.get(routingPrice), 101);
+    EXPECT_EQ(routingCounter, 1);
+    EXPECT_EQ(reportCounter, 0);
+
+    d_engine.set(spot, 200);
+    EXPECT_EQ(d_engine.get(routingPrice), 201);
+    EXPECT_EQ(routingCounter, 2);
+    EXPECT_EQ(reportCounter, 0);
+    EXPECT_EQ(d_engine.getLatency(10).count, 2);
+
+    EXPECT_EQ(d_engine.get(report), 2005);
+    EXPECT_EQ(reportCounter, 1);
+    EXPECT_EQ(d_engine.getLatency(0).count, 1);
+    EXPECT_TRUE(d_engine.isStabilized());
+
+    // Reads that find only lower-priority work pending recompute nothing.
+    d_engine.set(spot, 300);
+    EXPECT_EQ(d_engine.get(routingPrice), 301);
+    EXPECT_EQ(d_engine.get(routingPrice), 301);
+    EXPECT_EQ(d_engine.getLatency(10).count, 3);
+}
+
+TEST_F(EngineFixture, Unobserve_keepsDependenciesOfOtherObservers) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+    auto c(Anchors::map<int>(b, [](int x) { return x * 2; }));
+
+    d_engine.observe(c);
+    d_engine.observe(b, 5);
+    EXPECT_EQ(d_engine.get(c), 4);
+
+    d_engine.unobserve(b);
+    d_engine.set(a, 10);
+
+    EXPECT_EQ(d_engine.get(c), 22);
+}
+
+TEST_F(EngineFixture, MemoizedMap_reusesResultsForPreviousInputs) {
+    auto regime(Anchors::create(std::string("calm")));
+
+    int  updaterCounter = 0;
+    auto parameters(Anchors::map<int, std::string>(
+        regime,
+        [&updaterCounter](const std::string& r) {
+            updaterCounter++;
+            return static_cast<int>(r.size());
+        },
+        MemoOptions{2}));
+
+    d_engine.observe(parameters);
+    EXPECT_EQ(d_engine.get(parameters), 4);
+
+    d_engine.set(regime, std::string("stressed"));
+    EXPECT_EQ(d_engine.get(parameters), 8);
+
+    d_engine.set(regime, std::string("calm"));
+    EXPECT_EQ(d_engine.get(parameters), 4);
+    EXPECT_EQ(updaterCounter, 2);
+
+    d_engine.set(regime, std::string("crisis"));
+    EXPECT_EQ(d_engine.get(parameters), 6);
+
+    // "stressed" was the least recently used input, so it was evicted.
+    d_engine.set(regime, std::string("stressed"));
+    EXPECT_EQ(d_engine.get(parameters), 8);
+    EXPECT_EQ(updaterCounter, 4);
+
+    MemoStats stats = parameters->getMemoStats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 4);
+    EXPECT_EQ(stats.evictions, 2);
+    EXPECT_EQ(stats.entries, 2);
+}
+
+TEST_F(EngineFixture, MemoizedMap_keysOnTheInputBeforeTheUpdaterRuns) {
+    auto regime(Anchors::create(std::string("calm")));
+
+    int  updaterCounter = 0;
+    auto parameters(Anchors::map<int, std::string>(
+        regime,
+        [&updaterCounter](std::string& r) {
+            updaterCounter++;
+            std::string taken(std::move(r));
+            r.clear();
+            return static_cast<int>(taken.size());
+        },
+        MemoOptions()));
+
+    d_engine.observe(parameters);
+    EXPECT_EQ(d_engine.get(parameters), 4);
+
+    d_engine.set(regime, std::string("stressed"));
+    EXPECT_EQ(d_engine.get(parameters), 8);
+
+    d_engine.set(regime, std::string("calm"));
+    EXPECT_EQ(d_engine.get(parameters), 4);
+    EXPECT_EQ(updaterCounter, 2);
+    EXPECT_EQ(parameters->getMemoStats().hits, 1);
+}
+
+TEST_F(EngineFixture, MemoizedMap2_keysOnBothInputs) {
+    auto toggle(Anchors::create(true));
+    auto tenor(Anchors::create(5));
+
+    int  updaterCounter = 0;
+    auto rate(Anchors::map2<double, bool, int>(
+        toggle,
+        tenor,
+        [&updaterCounter](bool t, int years) {
+            updaterCounter++;
+            return t ? years * 0.5 : years * 0.25;
+        },
+        MemoOptions()));
+
+    d_engine.observe(rate);
+    EXPECT_EQ(d_engine.get(rate), 2.5);
+
+    d_engine.set(toggle, false);
+    EXPECT_EQ(d_engine.get(rate), 1.25);
+
+    d_engine.set(toggle, true);
+    EXPECT_EQ(d_engine.get(rate), 2.5);
+
+    d_engine.set(tenor, 10);
+    EXPECT_EQ(d_engine.get(rate), 5.0);
+
+    EXPECT_EQ(updaterCounter, 3);
+    EXPECT_EQ(rate->getMemoStats().hits, 1);
+}
+
+TEST_F(EngineFixture, Immutable_sharesOneBufferAcrossTheGraph) {
+    using Prices = Immutable<std::vector<double>>;
+
+    auto prices(Anchors::create(Prices(std::vector<double>(1000, 1.5))));
+    auto scale(Anchors::create(2.0));
+    auto offset(Anchors::create(1.0));
+
+    const double* seen = nullptr;
+    auto          total(Anchors::map3<double, Prices, double, double>(
+        prices,
+        scale,
+        offset,
+        [&seen](Prices& p, double& s, double& o) {
+            seen = p->data();
+            return std::accumulate(p->begin(), p->end(), 0.0) * s + o;
+        }));
+
+    auto passThrough(Anchors::map<Prices, Prices>(
+        prices, [](Prices& p) { return p; }));
+
+    d_engine.observe(total);
+    d_engine.observe(passThrough);
+    EXPECT_EQ(d_engine.get(total), 3001.0);
+
+    // Neither the pair node built by map3 nor get() copied the payload.
+    EXPECT_EQ(seen, d_engine.get(prices)->data());
+    EXPECT_TRUE(d_engine.get(passThrough).isSameBuffer(d_engine.get(prices)));
+
+    Prices updated = d_engine.get(prices).update([](std::vector<double>& v) {
+        v[0] = 101.5;
+    });
+    d_engine.set(prices, updated);
+    EXPECT_EQ(d_engine.get(total), 3201.0);
+    EXPECT_EQ(seen, updated->data());
+}
+
+TEST_F(EngineFixture, Immutable_equalValuesDoNotPropagate) {
+    using Names = Immutable<std::vector<std::string>>;
+
+    auto names(Anchors::create(Names(std::vector<std::string>{"a", "b"})));
+
+    int  updaterCounter = 0;
+    auto count(Anchors::map<std::size_t, Names>(
+        names, [&updaterCounter](Names& n) {
+            updaterCounter++;
+            return n->size();
+        }));
+
+    d_engine.observe(count);
+    EXPECT_EQ(d_engine.get(count), 2);
+
+    d_engine.set(names, d_engine.get(names));
+    d_engine.set(names, Names(std::vector<std::string>{"a", "b"}));
+    EXPECT_EQ(d_engine.get(count), 2);
+    EXPECT_EQ(updaterCounter, 1);
+
+    EXPECT_EQ(Names(), Names(std::vector<std::string>()));
+}
+
+TEST_F(EngineFixture, Freeze_nodesWithOnlyFrozenInputsAreFrozen) {
+    auto rate(Anchors::create(2));
+    auto tenor(Anchors::create(3));
+    auto notional(Anchors::create(10));
+
+    int  factorCounter = 0;
+    auto factor(Anchors::map2<int>(
+        rate, tenor, [&factorCounter](int r, int t) {
+            factorCounter++;
+            return r * t;
+        }));
+    auto value(Anchors::map2<int>(
+        factor, notional, [](int f, int n) { return f * n; }));
+
+    d_engine.observe(value);
+    EXPECT_EQ(d_engine.get(value), 60);
+
+    d_engine.freeze(rate);
+    EXPECT_FALSE(factor->isFrozen());
+
+    d_engine.set(tenor, 4);
+    d_engine.freeze(tenor);
+    EXPECT_TRUE(factor->isFrozen());
+    EXPECT_FALSE(value->isFrozen());
+    EXPECT_EQ(d_engine.get(value), 80);
+
+    // Frozen Anchors are unlinked from the graph.
+    EXPECT_TRUE(rate->getDependants().empty());
+    EXPECT_TRUE(factor->getDependants().empty());
+    EXPECT_THROW(d_engine.set(rate, 5), std::logic_error);
+
+    d_engine.set(notional, 20);
+    EXPECT_EQ(d_engine.get(value), 160);
+    EXPECT_EQ(factorCounter, 2);
+}
+
+TEST_F(EngineFixture, Freeze_freezesTheWholeCone) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+    auto c(Anchors::map<int>(b, [](int x) { return x * 10; }));
+
+    d_engine.freeze(b);
+    EXPECT_TRUE(a->isFrozen());
+    EXPECT_TRUE(b->isFrozen());
+    EXPECT_EQ(d_engine.get(b), 2);
+
+    // `c` is frozen once it is observed, since its only input is frozen.
+    d_engine.observe(c);
+    EXPECT_TRUE(c->isFrozen());
+    EXPECT_EQ(d_engine.get(c), 20);
+}
+
+TEST_F(EngineFixture, Observer_readsUpToDateValues) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::create(2));
+
+    int  updaterCounter = 0;
+    auto sum(Anchors::map2<int>(a, b, [&updaterCounter](int x, int y) {
+        updaterCounter++;
+        return x + y;
+    }));
+
+    Observer<int> observer = d_engine.observe(sum);
+    EXPECT_EQ(observer.get(), 3);
+
+    d_engine.set(a, 10);
+    d_engine.set(b, 20);
+    EXPECT_EQ(observer.get(), 30);
+    EXPECT_EQ(observer.get(), 30);
+    EXPECT_EQ(updaterCounter, 2);
+    EXPECT_EQ(d_engine.get(sum), 30);
+}
+
+TEST_F(EngineFixture, Observer_seesChangesMadeByOtherReads) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::map<int>(a, [](int x) { return x * 2; }));
+    auto c(Anchors::map<int>(a, [](int x) { return x * 3; }));
+
+    Observer<int> first  = d_engine.observe(b);
+    Observer<int> second = d_engine.observe(c);
+    EXPECT_EQ(first.get(), 2);
+    EXPECT_EQ(second.get(), 3);
+
+    d_engine.set(a, 5);
+    EXPECT_EQ(first.get(), 10);
+    EXPECT_EQ(second.get(), 15);
+
+    // An unobserved Anchor is no longer brought up-to-date.
+    d_engine.unobserve(c);
+    d_engine.set(a, 7);
+    EXPECT_EQ(first.get(), 14);
+    EXPECT_EQ(second.get(), 15);
+}
+
+TEST_F(EngineFixture, Compile_stabilizesLikeTheRecomputeHeap) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::create(2));
+
+    int  sumCounter = 0;
+    auto sum(Anchors::map2<int>(a, b, [&sumCounter](int x, int y) {
+        sumCounter++;
+        return x + y;
+    }));
+    auto parity(Anchors::map<int>(sum, [](int x) { return x % 2; }));
+
+    int  reportCounter = 0;
+    auto report(Anchors::map2<int>(
+        parity, b, [&reportCounter](int p, int y) {
+            reportCounter++;
+            return p * 100 + y;
+        }));
+
+    d_engine.observe(report);
+    d_engine.observe(sum, 10);
+    d_engine.compile();
+    EXPECT_TRUE(d_engine.isCompiled());
+    EXPECT_EQ(d_engine.get(report), 102);
+
+    // `parity` does not change, so `report` is only recomputed for `b`.
+    d_engine.set(a, 3);
+    EXPECT_EQ(d_engine.get(sum), 5);
+    EXPECT_FALSE(d_engine.isUpToDate(report));
+
+    d_engine.set(b, 4);
+    EXPECT_FALSE(d_engine.stabilizeSteps(1));
+    EXPECT_TRUE(d_engine.isUpToDate(sum));
+    EXPECT_EQ(d_engine.get(report), 104);
+    EXPECT_EQ(sumCounter, 3);
+    EXPECT_EQ(reportCounter, 2);
+    EXPECT_TRUE(d_engine.isStabilized());
+}
+
+TEST_F(EngineFixture, Compile_fallsBackWhenTheGraphChanges) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+    auto c(Anchors::map<int>(a, [](int x) { return x * 10; }));
+
+    d_engine.observe(b);
+    d_engine.compile();
+
+    // Pending changes are carried over to the recompute heap.
+    d_engine.set(a, 2);
+    d_engine.observe(c);
+    EXPECT_FALSE(d_engine.isCompiled());
+    EXPECT_EQ(d_engine.get(b), 3);
+    EXPECT_EQ(d_engine.get(c), 20);
+
+    d_engine.set(a, 3);
+    d_engine.compile();
+    d_engine.unobserve(c);
+    EXPECT_FALSE(d_engine.isCompiled());
+    EXPECT_EQ(d_engine.get(b), 4);
+}
+
+TEST_F(EngineFixture, Compile_skipsPendingAnchorsOutsideTheSchedule) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::map<int>(a, [](int x) { return x + 1; }));
+    auto c(Anchors::map<int>(a, [](int x) { return x * 10; }));
+    auto e(Anchors::create(5));
+    auto d(Anchors::map<int>(e, [](int x) { return x - 1; }));
+
+    d_engine.observe(b);
+    d_engine.observe(c);
+    d_engine.observe(d);
+
+    d_engine.set(a, 2);
+    d_engine.set(e, 6);
+    d_engine.unobserve(b);
+    d_engine.freeze(d);
+    d_engine.compile();
+    EXPECT_TRUE(d_engine.isCompiled());
+    EXPECT_EQ(d_engine.get(c), 20);
+    EXPECT_EQ(d_engine.get(d), 5);
+
+    d_engine.set(a, 3);
+    EXPECT_EQ(d_engine.get(c), 30);
+    EXPECT_TRUE(d_engine.isCompiled());
+}
+
+TEST_F(EngineFixture, Select_recomputesOnlyTheOldAndNewKeys) {
+    auto key(Anchors::create(3));
+    auto selector(Anchors::select(key));
+
+    std::vector<AnchorPtr<bool>> selected;
+    for (int i = 0; i < 100; i++) {
+        selected.push_back(selector->isSelected(i));
+        d_engine.observe(selected.back());
+    }
+    EXPECT_EQ(selector->isSelected(3), selected[3]);
+    EXPECT_TRUE(d_engine.get(selected[3]));
+    EXPECT_FALSE(d_engine.get(selected[7]));
+
+    // The selector and the Anchors for keys 3 and 7 are recomputed.
+    d_engine.set(key, 7);
+    EXPECT_TRUE(d_engine.stabilizeSteps(3));
+    EXPECT_FALSE(d_engine.get(selected[3]));
+    EXPECT_TRUE(d_engine.get(selected[7]));
+
+    d_engine.compile();
+    d_engine.set(key, 42);
+    EXPECT_TRUE(d_engine.stabilizeSteps(3));
+    EXPECT_FALSE(d_engine.get(selected[7]));
+    EXPECT_TRUE(d_engine.get(selected[42]));
+    EXPECT_TRUE(d_engine.isCompiled());
+}
+
+TEST_F(EngineFixture, Select_otherDependantsSeeEveryChange) {
+    auto key(Anchors::create(std::string("a")));
+    auto selector(Anchors::select(key));
+    auto isB(selector->isSelected("b"));
+
+    int  lengthCounter = 0;
+    auto length(Anchors::map<int, std::string>(
+        selector, [&lengthCounter](const std::string& s) {
+            lengthCounter++;
+            return static_cast<int>(s.size());
+        }));
+
+    d_engine.observe(isB);
+    d_engine.observe(length);
+    EXPECT_FALSE(d_engine.get(isB));
+    EXPECT_EQ(d_engine.get(length), 1);
+
+    d_engine.set(key, std::string("ccc"));
+    EXPECT_FALSE(d_engine.get(isB));
+    EXPECT_EQ(d_engine.get(length), 3);
+
+    // A key Anchor that is created while the key is already selected starts
+    // out true.
+    d_engine.set(key, std::string("b"));
+    auto isBAgain(selector->isSelected("b"));
+    EXPECT_EQ(isBAgain, isB);
+    EXPECT_TRUE(d_engine.get(isB));
+    EXPECT_EQ(lengthCounter, 3);
+}
+
+TEST_F(EngineFixture, Aggregate_foldVisitsOnlyTheChangedInputs) {
+    std::vector<AnchorPtr<int>> inputs;
+    for (int i = 1; i <= 1000; i++) {
+        inputs.push_back(Anchors::create(i));
+    }
+
+    int  addCounter    = 0;
+    int  removeCounter = 0;
+    auto total(Anchors::fold<long, int>(
+        inputs,
+        0,
+        [&addCounter](const long& sum, const int& x) {
+            addCounter++;
+            return sum + x;
+        },
+        [&removeCounter](const long& sum, const int& x) {
+            removeCounter++;
+            return sum - x;
+        }));
+
+    d_engine.observe(total);
+    EXPECT_EQ(d_engine.get(total), 500500);
+    EXPECT_EQ(addCounter, 1000);
+
+    d_engine.set(inputs[0], 11);
+    d_engine.set(inputs[999], 0);
+    EXPECT_EQ(d_engine.get(total), 500500 + 10 - 1000);
+    EXPECT_EQ(addCounter, 1002);
+    EXPECT_EQ(removeCounter, 2);
+
+    d_engine.compile();
+    d_engine.set(inputs[500], 1);
+    EXPECT_EQ(d_engine.get(total), 500500 + 10 - 1000 - 500);
+    EXPECT_EQ(addCounter, 1003);
+
+    // Changes made while it isn't observed are picked up by a rebuild.
+    d_engine.unobserve(total);
+    d_engine.set(inputs[1], 0);
+    d_engine.observe(total);
+    EXPECT_EQ(d_engine.get(total), 500500 + 10 - 1000 - 500 - 2);
+
+    auto sum(Anchors::sum(inputs));
+    d_engine.observe(sum);
+    EXPECT_EQ(d_engine.get(sum), d_engine.get(total));
+}
+
+TEST_F(EngineFixture, Aggregate_reduceUpdatesItsTree) {
+    std::vector<AnchorPtr<int>> inputs;
+    for (int i = 0; i < 100; i++) {
+        inputs.push_back(Anchors::create((i * 37) % 100));
+    }
+
+    int  maxCounter = 0;
+    auto maximum(Anchors::reduce<int>(
+        inputs, [&maxCounter](const int& x, const int& y) {
+            maxCounter++;
+            return std::max(x, y);
+        }));
+
+    d_engine.observe(maximum);
+    EXPECT_EQ(d_engine.get(maximum), 99);
+
+    // Each changed input only updates the nodes on its path to the root.
+    maxCounter = 0;
+    d_engine.set(inputs[27], 0);
+    EXPECT_EQ(d_engine.get(maximum), 98);
+    EXPECT_LE(maxCounter, 8);
+
+    EXPECT_THROW(Anchors::reduce<int>({}, [](const int& x, const int&) {
+                     return x;
+                 }),
+                 std::invalid_argument);
+}
+
+TEST_F(EngineFixture, Peek_computesOnlyWhatChanged) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::create(2));
+
+    int  doubleCounter = 0;
+    auto doubled(Anchors::map<int>(a, [&doubleCounter](int x) {
+        doubleCounter++;
+        return x * 2;
+    }));
+
+    int  sumCounter = 0;
+    auto sum(Anchors::map2<int>(doubled, b, [&sumCounter](int x, int y) {
+        sumCounter++;
+        return x + y;
+    }));
+
+    EXPECT_EQ(d_engine.peek(sum), 4);
+    EXPECT_EQ(d_engine.peek(sum), 4);
+    EXPECT_EQ(doubleCounter, 1);
+    EXPECT_EQ(sumCounter, 1);
+
+    d_engine.set(b, 3);
+    EXPECT_EQ(d_engine.peek(sum), 5);
+    EXPECT_EQ(doubleCounter, 1);
+    EXPECT_EQ(sumCounter, 2);
+
+    // Nothing was left observed.
+    EXPECT_FALSE(d_engine.isUpToDate(sum));
+    d_engine.set(a, 5);
+    EXPECT_EQ(d_engine.get(sum), 5);
+    EXPECT_EQ(d_engine.peek(sum), 13);
+}
+
+TEST_F(EngineFixture, Peek_stabilizesObservedDependencies) {
+    auto a(Anchors::create(1));
+
+    int  doubleCounter = 0;
+    auto doubled(Anchors::map<int>(a, [&doubleCounter](int x) {
+        doubleCounter++;
+        return x * 2;
+    }));
+    auto plusOne(Anchors::map<int>(doubled, [](int x) { return x + 1; }));
+
+    std::vector<AnchorPtr<int>> inputs{doubled, a};
+    auto                        total(Anchors::sum(inputs));
+
+    d_engine.observe(plusOne);
+    EXPECT_EQ(d_engine.peek(total), 3);
+
+    d_engine.set(a, 10);
+    EXPECT_EQ(d_engine.peek(total), 30);
+    EXPECT_EQ(doubleCounter, 2);
+
+    // Only the observed Anchors it depends on were brought up-to-date.
+    EXPECT_FALSE(d_engine.isUpToDate(plusOne));
+    EXPECT_EQ(d_engine.get(plusOne), 21);
+}
+
+TEST_F(EngineFixture, Scenario_revertsWithoutRecomputing) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::create(2));
+
+    int  sumCounter = 0;
+    auto sum(Anchors::map2<int>(a, b, [&sumCounter](int x, int y) {
+        sumCounter++;
+        return x + y;
+    }));
+    auto doubled(Anchors::map<int>(sum, [](int x) { return x * 2; }));
+
+    d_engine.observe(doubled);
+    EXPECT_EQ(d_engine.get(doubled), 6);
+
+    Scenario scenario(d_engine.beginScenario());
+    EXPECT_THROW(d_engine.beginScenario(), std::logic_error);
+    EXPECT_THROW(d_engine.freeze(a), std::logic_error);
+
+    d_engine.set(a, 10);
+    EXPECT_EQ(d_engine.get(doubled), 24);
+    EXPECT_EQ(sumCounter, 2);
+
+    scenario.revert();
+    EXPECT_FALSE(scenario.isActive());
+    EXPECT_TRUE(d_engine.isUpToDate(doubled));
+    EXPECT_EQ(d_engine.get(doubled), 6);
+    EXPECT_EQ(d_engine.get(a), 1);
+    EXPECT_EQ(sumCounter, 2);
+
+    d_engine.set(b, 3);
+    EXPECT_EQ(d_engine.get(doubled), 8);
+    EXPECT_EQ(sumCounter, 3);
+}
+
+TEST_F(EngineFixture, Scenario_keepsWorkPendingBeforeIt) {
+    auto a(Anchors::create(1));
+    auto b(Anchors::create(2));
+    auto sum(Anchors::map2<int>(a, b, [](int x, int y) { return x + y; }));
+
+    d_engine.observe(sum);
+    d_engine.compile();
+    EXPECT_EQ(d_engine.get(sum), 3);
+
+    d_engine.set(a, 5);
+    {
+        Scenario scenario(d_engine.beginScenario());
+        d_engine.set(b, 20);
+        EXPECT_EQ(d_engine.get(sum), 25);
+    }
+
+    // The change made before the scenario is still applied.
+    EXPECT_FALSE(d_engine.isUpToDate(sum));
+    EXPECT_EQ(d_engine.get(sum), 7);
+    EXPECT_TRUE(d_engine.isCompiled());
+}
+
+TEST_F(EngineFixture, Scenario_keepsAnchorsObservedDuringIt) {
+    auto a(Anchors::create(0));
+    auto b(Anchors::map<int>(a, [](int x) { return x + 101; }));
+
+    {
+        Scenario scenario(d_engine.beginScenario());
+        d_engine.set(a, 5);
+        d_engine.observe(b);
+    }
+
+    // `b` was never computed, so it is still computed after the revert.
+    EXPECT_EQ(d_engine.get(a), 0);
+    EXPECT_EQ(d_engine.get(b), 101);
+}
+
+TEST_F(EngineFixture, Construct_buildsGraphsFromManyThreads) {
+    auto                        shared(Anchors::create(1));
+    std::vector<AnchorPtr<int>> parts[4];
+    std::vector<std::thread>    builders;
+
+    for (int t = 0; t < 4; t++) {
+        builders.emplace_back([&parts, &shared, t]() {
+            for (int i = 0; i < 1000; i++) {
+                auto input(Anchors::create(i));
+                parts[t].push_back(Anchors::map2<int>(
+                    input, shared, [](int x, int y) { return x + y; }));
+            }
+        });
+    }
+    for (auto& builder : builders) {
+        builder.join();
+    }
+
+    std::vector<AnchorPtr<int>>              tips;
+    std::unordered_set<AnchorBase::AnchorId> ids;
+    for (auto& part : parts) {
+        for (auto& anchor : part) {
+            ids.insert(static_cast<const AnchorBase&>(*anchor).getId());
+            tips.push_back(anchor);
+        }
+    }
+    EXPECT_EQ(ids.size(), tips.size());
+
+    d_engine.observe(tips);
+    EXPECT_EQ(d_engine.get(tips[0]), 1);
+    EXPECT_EQ(d_engine.get(tips.back()), 1000);
+
+    d_engine.set(shared, 2);
+    EXPECT_EQ(d_engine.get(tips.back()), 1001);
+}
+
+TEST_F(EngineFixture, Stabilizer_stabilizesOnItsOwnThread) {
+    auto a(Anchors::create(1));
+
+    std::thread::id updaterThread;
+    auto            b(Anchors::map<int>(a, [&updaterThread](int x) {
+        updaterThread = std::this_thread::get_id();
+        if (x < 0) {
+            throw std::invalid_argument("negative");
+        }
+        return x * 2;
+    }));
+
+    d_engine.observe(b);
+    d_engine.startStabilizer();
+    EXPECT_EQ(d_engine.get(b, d_engine.changeNumber()), 2);
+
+    std::thread writer([this, &a]() { d_engine.set(a, 5); });
+    writer.join();
+    EXPECT_EQ(d_engine.get(b, d_engine.changeNumber()), 10);
+    EXPECT_NE(updaterThread, std::this_thread::get_id());
+
+    // Exceptions thrown on the stabilizer thread are rethrown by `get()`.
+    d_engine.set(a, -1);
+    EXPECT_THROW(d_engine.get(b, d_engine.changeNumber()),
+                 std::invalid_argument);
+
+    d_engine.stopStabilizer();
+    d_engine.set(a, 6);
+    EXPECT_EQ(d_engine.get(b), 12);
+    EXPECT_EQ(updaterThread, std::this_thread::get_id());
+}
+
+TEST_F(EngineFixture, Stabilizer_drainsFeedsWhenUpdatesArePushed) {
+    auto price(Anchors::create(0));
+    auto doubled(Anchors::map<int>(price, [](int p) { return p * 2; }));
+
+    InputFeed<int> feed(4);
+    auto           slot = feed.addAnchor(price);
+
+    d_engine.observe(doubled);
+    d_engine.startStabilizer();
+    EXPECT_EQ(d_engine.get(doubled, d_engine.changeNumber()), 0);
+
+    d_engine.addFeed(feed);
+    for (int i = 1; i <= 3; i++) {
+        EXPECT_TRUE(feed.push(slot, i));
+        EXPECT_EQ(d_engine.get(doubled, d_engine.changeNumber()), i * 2);
+    }
+
+    // A push alone wakes the stabilizer thread.
+    EXPECT_TRUE(feed.push(slot, 10));
+    while (d_engine.get(doubled) != 20) {
+        std::this_thread::yield();
+    }
+
+    d_engine.removeFeed(feed);
+    d_engine.stopStabilizer();
+}
+
+TEST_F(EngineFixture, Stabilizer_coalescesChanges) {
+    auto a(Anchors::create(0));
+
+    std::atomic<int> updaterCounter = 0;
+    auto             b(Anchors::map<int>(a, [&updaterCounter](int x) {
+        updaterCounter++;
+        return x + 1;
+    }));
+
+    d_engine.observe(b);
+    d_engine.startStabilizer(std::chrono::milliseconds(200));
+    EXPECT_EQ(d_engine.get(b, d_engine.changeNumber()), 1);
+
+    for (int i = 1; i <= 10; i++) {
+        d_engine.set(a, i);
+    }
+    EXPECT_EQ(d_engine.get(b, d_engine.changeNumber()), 11);
+    EXPECT_EQ(updaterCounter, 2);
+}
+
 }  // namespace anchorstest
@@ -0,0 +1,113 @@
+#include "../include/recorder.h"
+
+#include "../include/engine.h"
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace anchors;
+
+namespace anchorstest {
+
+namespace {
+
+// Calls of the "recorder.price" updater. The updaters stay registered after
+// the fixture is destroyed, so they can't refer to it.
+int s_priceCounter = 0;
+
+}  // namespace
+
+class RecorderFixture : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        d_path = std::filesystem::temp_directory_path() /
+                 "anchors_recorder_test.trace";
+
+        s_priceCounter = 0;
+
+        auto& registry = ReplayRegistry::instance();
+        registry.addMap2<double>("recorder.price", [](double& s, double& q) {
+            s_priceCounter++;
+            return s * q;
+        });
+        registry.addMap<long, double>("recorder.round", [](double& v) {
+            return static_cast<long>(v);
+        });
+    }
+
+    void TearDown() override { std::filesystem::remove(d_path); }
+
+    std::filesystem::path d_path;
+};
+
+TEST_F(RecorderFixture, Replay_recomputesTheSameAnchors) {
+    {
+        Recorder recorder(d_path);
+        Engine   engine;
+
+        auto spot(recorder.create(100.0));
+        auto quantity(recorder.create(2.0));
+        auto value(recorder.map2<double>(spot, quantity, "recorder.price"));
+        auto rounded(recorder.map<long, double>(value, "recorder.round"));
+
+        engine.setRecorder(&recorder);
+        engine.observe(rounded);
+        EXPECT_EQ(engine.get(rounded), 200);
+
+        engine.set(spot, 100.0);
+        engine.set(spot, 101.5);
+        EXPECT_EQ(engine.get(rounded), 203);
+
+        engine.unobserve(rounded);
+        engine.set(quantity, 4.0);
+        engine.get(rounded);
+    }
+
+    EXPECT_EQ(s_priceCounter, 2);
+    s_priceCounter = 0;
+
+    ReplayReport report = Replayer(d_path).run();
+    EXPECT_EQ(s_priceCounter, 2);
+    EXPECT_EQ(report.numNodes, 4);
+    EXPECT_EQ(report.numOperations, 12);
+    EXPECT_EQ(report.numGets, 3);
+    EXPECT_LE(report.p50, report.max);
+}
+
+TEST_F(RecorderFixture, Record_rejectsUnregisteredUpdaters) {
+    Recorder recorder(d_path);
+
+    auto spot(recorder.create(100.0));
+    EXPECT_THROW(recorder.map<double>(spot, "recorder.unknown"),
+                 std::invalid_argument);
+    EXPECT_THROW((recorder.map<double, double>(spot, "recorder.round")),
+                 std::invalid_argument);
+
+    Engine engine;
+    auto   other(Anchors::create(1.0));
+
+    engine.setRecorder(&recorder);
+    EXPECT_THROW(engine.observe(other), std::invalid_argument);
+
+    // A change that can't be recorded isn't applied.
+    EXPECT_THROW(engine.set(other, 2.0), std::invalid_argument);
+    EXPECT_THROW(engine.update(other, [](double& v) { v = 3.0; }),
+                 std::invalid_argument);
+    engine.setRecorder(nullptr);
+    EXPECT_EQ(engine.get(other), 1.0);
+}
+
+TEST_F(RecorderFixture, Record_rejectsScenarios) {
+    Recorder recorder(d_path);
+    Engine   engine;
+
+    engine.setRecorder(&recorder);
+    EXPECT_THROW(engine.beginScenario(), std::logic_error);
+
+    engine.setRecorder(nullptr);
+    Scenario scenario(engine.beginScenario());
+    EXPECT_THROW(engine.setRecorder(&recorder), std::logic_error);
+}
+
+}  // namespace anchorstest
@@ -0,0 +1,68 @@
+#include "../include/shardedengine.h"
+
+#include "../include/anchorutil.h"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace anchors;
+
+namespace anchorstest {
+
+TEST(ShardedEngine, LinkedShards_observedValuesShouldBeConsistent) {
+    ShardedEngine engine(3);
+
+    // Shard 0 holds the shared market data; shards 1 and 2 hold one book each.
+    auto spot(Anchors::create(100));
+
+    auto bookOneSpot = engine.link(0, spot, 1);
+    auto bookTwoSpot = engine.link(0, spot, 2);
+
+    auto bookOneQuantity(Anchors::create(3));
+    auto bookOneValue(Anchors::map2<int>(
+        bookOneSpot, bookOneQuantity, [](int s, int q) { return s * q; }));
+
+    auto bookTwoValue(
+        Anchors::map<int>(bookTwoSpot, [](int s) { return s * -2; }));
+
+    engine.shard(1).observe(bookOneValue);
+    engine.shard(2).observe(bookTwoValue);
+
+    EXPECT_EQ(engine.get(1, bookOneValue), 300);
+    EXPECT_EQ(engine.get(2, bookTwoValue), -200);
+
+    engine.shard(0).set(spot, 110);
+    engine.stabilize();
+
+    EXPECT_EQ(engine.get(1, bookOneValue), 330);
+    EXPECT_EQ(engine.get(2, bookTwoValue), -220);
+
+    engine.shard(1).set(bookOneQuantity, 4);
+
+    EXPECT_EQ(engine.get(1, bookOneValue), 440);
+    EXPECT_EQ(engine.get(2, bookTwoValue), -220);
+}
+
+TEST(ShardedEngine, ChainedLinks_shouldStabilizeInOrder) {
+    ShardedEngine engine(3);
+
+    auto a(Anchors::create(1));
+    auto aPlusOne(Anchors::map<int>(a, [](int x) { return x + 1; }));
+
+    auto b(engine.link(0, aPlusOne, 1));
+    auto bTimesTen(Anchors::map<int>(b, [](int x) { return x * 10; }));
+
+    auto c(engine.link(1, bTimesTen, 2));
+
+    auto result(Anchors::map<int>(c, [](int x) { return x - 1; }));
+    engine.shard(2).observe(result);
+
+    EXPECT_EQ(engine.get(2, result), 19);
+
+    engine.shard(0).set(a, 4);
+    EXPECT_EQ(engine.get(2, result), 49);
+
+    EXPECT_THROW(engine.link(2, result, 0), std::invalid_argument);
+}
+
+}  // namespace anchorstest
@@ -0,0 +1,101 @@
+#include "../include/timerwheel.h"
+
+#include "../include/anchorutil.h"
+#include "../include/engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace anchors;
+
+namespace anchorstest {
+
+TEST(TimerWheel, Advance_firesExactlyTheExpiredTimers) {
+    std::mt19937_64 random(42);
+
+    const std::uint64_t start = std::uint64_t(1) << 40;
+    TimerWheel<int>     wheel(start);
+
+    std::vector<std::uint64_t> dues;
+    std::vector<bool>          fired;
+    for (int i = 0; i < 2000; i++) {
+        // Spread expiries over many levels of the wheel.
+        std::uint64_t due = start + (random() >> (1 + random() % 63));
+        dues.push_back(due);
+        fired.push_back(false);
+        wheel.insert(due, i);
+    }
+
+    std::uint64_t now = start;
+    while (wheel.size() > 0) {
+        std::uint64_t step = random() >> (1 + random() % 63);
+        now = std::max(now, now + step);
+
+        std::uint64_t lastDue = 0;
+        wheel.advance(now, [&](int i) {
+            EXPECT_LE(dues[i], now);
+            EXPECT_GE(dues[i], lastDue);
+            EXPECT_FALSE(fired[i]);
+
+            lastDue  = dues[i];
+            fired[i] = true;
+        });
+
+        for (std::size_t i = 0; i < dues.size(); i++) {
+            ASSERT_EQ(fired[i], dues[i] <= now);
+        }
+    }
+}
+
+TEST(TimerWheel, TimeAnchors_changeWhenTheClockPassesTheirSteps) {
+    using namespace std::chrono_literals;
+
+    Engine engine;
+    engine.advanceClock(Time() + 1000s);
+
+    const Time expiry = engine.now() + 10s;
+
+    auto isExpired(Anchors::at(expiry));
+    auto isStale(Anchors::after(3s));
+    auto weight(Anchors::stepFunction(
+        1.0, {{expiry - 5s, 0.5}, {expiry - 8s, 0.75}, {expiry, 0.0}}));
+
+    int  labelCounter = 0;
+    auto label(Anchors::map2<std::string, bool, double>(
+        isExpired, weight, [&labelCounter](bool expired, double w) {
+            labelCounter++;
+            return expired ? std::string("expired") : std::to_string(w);
+        }));
+
+    engine.observe(label);
+    engine.observe(isStale);
+    EXPECT_EQ(engine.get(label), std::to_string(1.0));
+    EXPECT_FALSE(engine.get(isStale));
+
+    engine.advanceClock(engine.now() + 1s);
+    EXPECT_EQ(engine.get(label), std::to_string(1.0));
+    EXPECT_EQ(labelCounter, 1);
+
+    engine.advanceClock(engine.now() + 2s);
+    EXPECT_EQ(engine.get(label), std::to_string(0.75));
+    EXPECT_TRUE(engine.get(isStale));
+
+    engine.advanceClock(engine.now() + 20s);
+    EXPECT_EQ(engine.get(label), "expired");
+    EXPECT_EQ(labelCounter, 3);
+
+    EXPECT_THROW(engine.advanceClock(expiry), std::invalid_argument);
+
+    // Only the clock changes a TimeAnchor.
+    EXPECT_THROW(engine.set(isStale, false), std::logic_error);
+    EXPECT_THROW(engine.update(isStale, [](bool& v) { v = false; }),
+                 std::logic_error);
+    EXPECT_TRUE(engine.get(isStale));
+}
+
+}  // namespace anchorstest
@@ -0,0 +1,44 @@
+// anchors_replay.cpp
+//
+// Replays a trace written by anchors::Recorder and prints the latency of the
+// recorded `get()` calls. The updaters used by the trace must be registered in
+// anchors::ReplayRegistry by a source file linked into this executable; see
+// the ANCHORS_REPLAY_SOURCES CMake variable.
+
+#include "../include/recorder.h"
+
+#include <exception>
+#include <iostream>
+
+namespace {
+
+double toMicroseconds(std::chrono::nanoseconds duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <trace>\n";
+        return 2;
+    }
+
+    try {
+        anchors::ReplayReport report = anchors::Replayer(argv[1]).run();
+
+        std::cout << "nodes:      " << report.numNodes << "\n"
+                  << "operations: " << report.numOperations << "\n"
+                  << "gets:       " << report.numGets << "\n"
+                  << "total (us): " << toMicroseconds(report.total) << "\n"
+                  << "p50 (us):   " << toMicroseconds(report.p50) << "\n"
+                  << "p90 (us):   " << toMicroseconds(report.p90) << "\n"
+                  << "p99 (us):   " << toMicroseconds(report.p99) << "\n"
+                  << "max (us):   " << toMicroseconds(report.max) << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+// anchors_startup_bench.cpp
+//
+// Measures how long it takes to build and observe a graph of Anchors, with
+// the Anchors created by one thread or split between several threads. Each
+// thread builds chains of `map2()` Anchors over its own inputs, and the tips of
+// the chains are then observed with a single call to `Engine::observe()`.
+
+#include "../include/anchorutil.h"
+#include "../include/engine.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace anchors;
+
+// Length of each chain of Anchors.
+constexpr int k_CHAIN_LENGTH = 16;
+
+std::vector<AnchorPtr<int>> buildChains(int numChains) {
+    std::vector<AnchorPtr<int>> tips;
+    tips.reserve(numChains);
+
+    for (int i = 0; i < numChains; i++) {
+        AnchorPtr<int> input = Anchors::create(i);
+        AnchorPtr<int> tip   = input;
+        for (int j = 0; j < k_CHAIN_LENGTH; j++) {
+            tip = Anchors::map2<int>(
+                tip, input, [](int a, int b) { return a + b; });
+        }
+        tips.push_back(tip);
+    }
+
+    return tips;
+}
+
+double toMilliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <chains> <threads>\n";
+        return 2;
+    }
+
+    const int numChains  = std::atoi(argv[1]);
+    const int numThreads = std::atoi(argv[2]);
+    if (numChains <= 0 || numThreads <= 0) {
+        std::cerr << argv[0] << ": <chains> and <threads> must be positive\n";
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::vector<AnchorPtr<int>>> parts(numThreads);
+    std::vector<std::thread>                 threads;
+    for (int t = 0; t < numThreads; t++) {
+        int count = numChains / numThreads + (t < numChains % numThreads);
+        threads.emplace_back([&parts, t, count] {
+            parts[t] = buildChains(count);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<AnchorPtr<int>> tips;
+    tips.reserve(numChains);
+    for (auto& part : parts) {
+        tips.insert(tips.end(), part.begin(), part.end());
+    }
+
+    auto built = std::chrono::steady_clock::now();
+
+    Engine engine;
+    engine.observe(tips);
+
+    auto observed = std::chrono::steady_clock::now();
+
+    std::cout << "anchors:      " << numChains * (k_CHAIN_LENGTH + 1) << "\n"
+              << "threads:      " << numThreads << "\n"
+              << "build (ms):   " << toMilliseconds(built - start) << "\n"
+              << "observe (ms): " << toMilliseconds(observed - built) << "\n"
+              << "total (ms):   " << toMilliseconds(observed - start) << "\n";
+
+    return 0;
+}